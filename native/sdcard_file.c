@@ -0,0 +1,78 @@
+
+// Built into the native simulator runner, i.e. against the host libc
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sdcard_file.h"
+
+static int sd_fd = -1;
+
+// CSD 2.0 C_SIZE counts 512 KB units
+#define CARD_UNIT (512u << 10)
+
+int sdcard_file_open(const char *path, uint64_t *size, uint8_t **mem)
+{
+  sd_fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (sd_fd < 0)
+  {
+    int err = errno;
+    fprintf(stderr, "sdcard: failed to open '%s': %s\n", path, strerror(err));
+    return -err;
+  }
+
+  struct stat st;
+  if (fstat(sd_fd, &st) < 0)
+  {
+    int err = errno;
+    fprintf(stderr, "sdcard: failed to stat '%s': %s\n", path, strerror(err));
+    close(sd_fd);
+    sd_fd = -1;
+    return -err;
+  }
+
+  // Keep the contents of a larger image, only ever grow the file
+  if ((uint64_t)st.st_size >= *size)
+    *size = (uint64_t)st.st_size / CARD_UNIT * CARD_UNIT;
+  else if (ftruncate(sd_fd, (off_t)*size) < 0)
+  {
+    int err = errno;
+    fprintf(stderr, "sdcard: failed to resize '%s': %s\n", path, strerror(err));
+    close(sd_fd);
+    sd_fd = -1;
+    return -err;
+  }
+
+  void *p = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, sd_fd, 0);
+  if (p == MAP_FAILED)
+  {
+    int err = errno;
+    fprintf(stderr, "sdcard: failed to map '%s': %s\n", path, strerror(err));
+    close(sd_fd);
+    sd_fd = -1;
+    return -err;
+  }
+
+  *mem = (uint8_t *)p;
+  return 0;
+}
+
+void sdcard_file_close(uint8_t *mem, uint64_t size)
+{
+  if (mem)
+  {
+    msync(mem, size, MS_SYNC);
+    munmap(mem, size);
+  }
+
+  if (sd_fd >= 0)
+  {
+    close(sd_fd);
+    sd_fd = -1;
+  }
+}
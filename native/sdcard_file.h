@@ -0,0 +1,12 @@
+
+#pragma once
+
+#include <stdint.h>
+
+// Host side of the emulated SD card (native_sim only).
+// Maps 'path' into memory. A missing or smaller file is created/extended to '*size'
+// bytes; a larger one (e.g. a real card dump) is never truncated, '*size' is set to
+// its length, rounded down to the 512 KB card capacity unit.
+
+int  sdcard_file_open(const char *path, uint64_t *size, uint8_t **mem);
+void sdcard_file_close(uint8_t *mem, uint64_t size);
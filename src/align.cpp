@@ -0,0 +1,482 @@
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sd/sd_spec.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "types.h"
+#include "sdtool.h"
+
+// ----- Partition / file system alignment analyzer
+//
+// A file system is only as aligned as its data region: partition start plus the
+// FAT/exFAT/ext2 metadata in front of the first cluster. If that lands off an
+// AU or erase sector border, every AU-sized sequential write spans two AUs and
+// the card has to read-modify-write both.
+
+#define BLK SDMMC_DEFAULT_BLOCK_SIZE
+#define MAX_PARTS 16
+
+static u8 *align_buf;  // pool buffer
+
+struct part_info
+{
+  u32  start;
+  u32  size;
+  u8   type;      // MBR type, 0xEE for GPT entries, 0 for a whole-card volume
+  char name[20];  // GPT partition name (ASCII part)
+};
+
+static part_info parts[MAX_PARTS];
+static int part_count;
+
+static int align_read(u32 lba)
+{
+  int rc = sd_read_blocks(lba, 1, align_buf);
+  if (rc)
+    shell_print(sh, "Read %u, rc %d", lba, rc);
+
+  return rc;
+}
+
+static void part_add(u32 start, u32 size, u8 type, const char *name)
+{
+  if (part_count >= MAX_PARTS)
+    return;
+
+  part_info &p = parts[part_count++];
+  p.start = start;
+  p.size  = size;
+  p.type  = type;
+  strncpy(p.name, name, sizeof(p.name) - 1);
+  p.name[sizeof(p.name) - 1] = 0;
+}
+
+static bool is_boot_sector(const u8 *b)
+{
+  if (b[0] != 0xEB && b[0] != 0xE9)
+    return false;
+
+  if (!memcmp(&b[3], "EXFAT   ", 8))
+    return true;
+
+  // BPB: 512-byte sectors, power-of-2 cluster, one or two FATs
+  return sys_get_le16(&b[11]) == BLK && b[13] && !(b[13] & (b[13] - 1)) && (b[16] == 1 || b[16] == 2);
+}
+
+// ----- Partition tables
+
+static int scan_gpt(u32 block_count)
+{
+  int rc = align_read(1);
+  if (rc) return rc;
+
+  if (memcmp(align_buf, "EFI PART", 8))
+  {
+    shell_fprintf(sh, SHELL_WARNING, "Protective MBR without GPT header\n");
+    return 0;
+  }
+
+  u32 lba   = sys_get_le64(&align_buf[72]);
+  u32 count = sys_get_le32(&align_buf[80]);
+  u32 esize = sys_get_le32(&align_buf[84]);
+
+  if (esize < 128 || esize > BLK || BLK % esize)
+    return -EINVAL;
+
+  for (u32 i = 0; i < count && part_count < MAX_PARTS; i++)
+  {
+    u32 off = (i * esize) % BLK;
+
+    if (off == 0)
+    {
+      rc = align_read(lba + i * esize / BLK);
+      if (rc) return rc;
+    }
+
+    const u8 *e = &align_buf[off];
+    static const u8 unused[16] = { 0 };
+    if (!memcmp(e, unused, 16))
+      continue;
+
+    u64 first = sys_get_le64(&e[32]);
+    u64 last  = sys_get_le64(&e[40]);
+    if (first >= block_count || last < first)
+      continue;
+
+    char name[20];
+    for (u32 j = 0; j < sizeof(name) - 1; j++)
+    {
+      u16 c = sys_get_le16(&e[56 + j * 2]);
+      name[j] = (c >= 0x20 && c < 0x7F) ? c : (c ? '?' : 0);
+    }
+    name[sizeof(name) - 1] = 0;
+
+    part_add(first, _min(last, (u64)block_count - 1) - first + 1, 0xEE, name);
+  }
+
+  return 0;
+}
+
+static int scan_mbr(u32 block_count)
+{
+  int rc = align_read(0);
+  if (rc) return rc;
+
+  if (align_buf[510] != 0x55 || align_buf[511] != 0xAA)
+  {
+    shell_fprintf(sh, SHELL_WARNING, "No MBR signature\n");
+    return 0;
+  }
+
+  // No partition table, the card is formatted as a single volume ("superfloppy")
+  if (is_boot_sector(align_buf))
+  {
+    part_add(0, block_count, 0, "");
+    return 0;
+  }
+
+  u8 mbr[64];
+  memcpy(mbr, &align_buf[446], sizeof(mbr));
+
+  for (int i = 0; i < 4; i++)
+  {
+    const u8 *e = &mbr[i * 16];
+    u8  type  = e[4];
+    u32 start = sys_get_le32(&e[8]);
+    u32 size  = sys_get_le32(&e[12]);
+
+    if (!type || !size)
+      continue;
+
+    if (type == 0xEE)
+      return scan_gpt(block_count);
+
+    if (type == 0x05 || type == 0x0F || type == 0x85)
+    {
+      // Extended partition: chain of EBRs, each holding one logical partition
+      u32 ebr = start;
+
+      for (int n = 0; n < MAX_PARTS && ebr < block_count; n++)
+      {
+        rc = align_read(ebr);
+        if (rc) return rc;
+
+        if (align_buf[510] != 0x55 || align_buf[511] != 0xAA)
+          break;
+
+        const u8 *l = &align_buf[446];
+        if (l[4] && sys_get_le32(&l[12]))
+          part_add(ebr + sys_get_le32(&l[8]), sys_get_le32(&l[12]), l[4], "");
+
+        u32 next = sys_get_le32(&l[16 + 8]);
+        if (!l[16 + 4] || !next)
+          break;
+
+        ebr = start + next;
+      }
+
+      continue;
+    }
+
+    part_add(start, size, type, "");
+  }
+
+  return 0;
+}
+
+// ----- File systems
+
+struct fs_info
+{
+  const char *name;
+  u32 cluster;   // blocks
+  u32 data_off;  // first cluster, blocks from partition start
+};
+
+// Data starts where the block group 0 metadata ends: superblock, group descriptors,
+// reserved GDT blocks, then bitmaps and inode tables - with flex_bg those of the whole
+// first flex group, packed together. Follow that run from the superblock; a table placed
+// further out (past a backup superblock) leaves data blocks in front of it.
+#define EXT_FLEX_MAX 64
+
+static u32 ext_meta[EXT_FLEX_MAX * 3];  // block bitmap, inode bitmap, inode table per group
+
+static int probe_ext(const part_info &p, fs_info &fs)
+{
+  const u8 *sb = align_buf;  // first 512 bytes of the superblock
+
+  u32 blocks_count  = sys_get_le32(&sb[4]);
+  u32 first_data    = sys_get_le32(&sb[20]);
+  u32 log_block     = sys_get_le32(&sb[24]);
+  u32 per_group     = sys_get_le32(&sb[32]);
+  u32 inodes_group  = sys_get_le32(&sb[40]);
+  u32 rev           = sys_get_le32(&sb[76]);
+  u32 inode_size    = rev ? sys_get_le16(&sb[88]) : 128;
+  u32 feat_compat   = sys_get_le32(&sb[92]);
+  u32 feat_incompat = sys_get_le32(&sb[96]);
+  u32 rsv_gdt       = (feat_compat & 0x10) ? sys_get_le16(&sb[206]) : 0;     // RESIZE_INODE
+  u32 desc_size     = (feat_incompat & 0x80) ? sys_get_le16(&sb[254]) : 32;  // 64BIT
+  u32 log_flex      = (feat_incompat & 0x200) ? sb[372] : 0;                  // FLEX_BG
+
+  fs.name = (feat_incompat & 0x40) ? "ext4" : (feat_compat & 0x04) ? "ext3" : "ext2";
+
+  // 1 KB .. 64 KB blocks
+  if (log_block > 6 || !per_group || !inodes_group || !inode_size ||
+      desc_size < 32 || desc_size > BLK || (desc_size & (desc_size - 1)) || log_flex > 31 ||
+      first_data >= blocks_count)
+  {
+    fs.name = "ext2/3/4, unrecognized superblock";
+    return 0;
+  }
+
+  u32 bs = 2u << log_block;  // block size in 512-byte blocks
+  fs.cluster = bs;
+
+  u32 groups = (blocks_count - first_data + per_group - 1) / per_group;
+  u32 n = _min(_min(1u << log_flex, groups), (u32)EXT_FLEX_MAX);
+  u32 itable = ((u64)inodes_group * inode_size + bs * BLK - 1) / (bs * BLK);
+  u32 gdt = ((u64)groups * desc_size + bs * BLK - 1) / (bs * BLK);
+
+  // Descriptors start in the block after the superblock's
+  u32 gdt_lba = p.start + (first_data + 1) * bs;
+
+  for (u32 i = 0; i < n; i++)
+  {
+    u32 off = (i * desc_size) % BLK;
+
+    if (off == 0)
+    {
+      int rc = align_read(gdt_lba + i * desc_size / BLK);
+      if (rc) return rc;
+    }
+
+    const u8 *d = &align_buf[off];
+    ext_meta[i * 3 + 0] = sys_get_le32(&d[0]);
+    ext_meta[i * 3 + 1] = sys_get_le32(&d[4]);
+    ext_meta[i * 3 + 2] = sys_get_le32(&d[8]);
+  }
+
+  u64 end = (u64)first_data + 1 + gdt + rsv_gdt;
+
+  for (bool grown = true; grown; )
+  {
+    grown = false;
+
+    for (u32 k = 0; k < n * 3; k++)
+    {
+      u64 len = (k % 3 == 2) ? itable : 1;
+
+      if (ext_meta[k] <= end && ext_meta[k] + len > end)
+      {
+        end = ext_meta[k] + len;
+        grown = true;
+      }
+    }
+  }
+
+  if (end >= blocks_count)
+  {
+    fs.name = "ext2/3/4, unrecognized group descriptors";
+    return 0;
+  }
+
+  fs.data_off = end * bs;
+  return 0;
+}
+
+static int probe_fs(const part_info &p, fs_info &fs)
+{
+  int rc = align_read(p.start);
+  if (rc) return rc;
+
+  fs.name     = "unknown";
+  fs.cluster  = 1;
+  fs.data_off = 0;
+
+  const u8 *b = align_buf;
+
+  if (!memcmp(&b[3], "EXFAT   ", 8))
+  {
+    // BytesPerSectorShift 9..12, clusters up to 32 MB (exFAT spec 3.1.14, 3.1.15)
+    u32 bps = b[108], spc = b[109];
+
+    if (bps < 9 || bps > 12 || spc > 25 - bps)
+    {
+      fs.name = "exFAT, unrecognized boot sector";
+      return 0;
+    }
+
+    fs.name     = "exFAT";
+    fs.cluster  = 1u << (bps + spc - 9);
+    fs.data_off = sys_get_le32(&b[88]) << (bps - 9);  // ClusterHeapOffset, in sectors
+    return 0;
+  }
+
+  if (is_boot_sector(b))
+  {
+    u32 rsc   = sys_get_le16(&b[14]);
+    u32 root  = (sys_get_le16(&b[17]) * 32 + BLK - 1) / BLK;
+    u32 fatsz = sys_get_le16(&b[22]) ? sys_get_le16(&b[22]) : sys_get_le32(&b[36]);
+    u32 total = sys_get_le16(&b[19]) ? sys_get_le16(&b[19]) : sys_get_le32(&b[32]);
+
+    fs.cluster  = b[13];
+    fs.data_off = rsc + b[16] * fatsz + root;
+
+    u32 clusters = (total > fs.data_off) ? (total - fs.data_off) / fs.cluster : 0;
+    fs.name = (clusters < 4085) ? "FAT12" : (clusters < 65525) ? "FAT16" : "FAT32";
+    return 0;
+  }
+
+  // ext2/3/4 superblock is at byte 1024 of the partition
+  rc = align_read(p.start + 2);
+  if (rc) return rc;
+
+  if (sys_get_le16(&align_buf[56]) == 0xEF53)
+    return probe_ext(p, fs);
+
+  return 0;
+}
+
+// ----- Report
+
+static void print_offset(const char *what, u32 lba, u32 erase_blocks, u32 au_blocks)
+{
+  u32 eo = lba % erase_blocks;
+  u32 ao = au_blocks ? lba % au_blocks : 0;
+
+  shell_fprintf(sh, SHELL_INFO, "  %-19s: ", what);
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "block %u, ", lba);
+  shell_fprintf(sh, eo ? SHELL_WARNING : SHELL_VT100_COLOR_WHITE, "+%u KB into erase sector", eo / 2);
+
+  if (au_blocks)
+  {
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, ", ");
+    shell_fprintf(sh, ao ? SHELL_WARNING : SHELL_VT100_COLOR_WHITE, "+%u KB into AU", ao / 2);
+  }
+
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "\n");
+}
+
+// Share of clusters crossing a 'unit' border, in 1/1000
+static u32 straddle_permille(u32 data_lba, u32 cluster, u32 unit)
+{
+  if (cluster >= unit)
+    return (data_lba % unit || cluster % unit) ? 1000 : 0;
+
+  // Cluster positions modulo 'unit' repeat with this period
+  u32 a = cluster, b = unit;
+  while (b) { u32 t = a % b; a = b; b = t; }
+  u32 period = unit / a;
+  u32 cross = 0;
+
+  for (u32 i = 0; i < period; i++)
+    if ((data_lba + (u64)i * cluster) % unit + cluster > unit)
+      cross++;
+
+  return (u64)cross * 1000 / period;
+}
+
+static void analyze(int n, const part_info &p, const sd_geom &g)
+{
+  fs_info fs;
+  u32 unit = g.au_blocks ? g.au_blocks : g.erase_blocks;
+
+  shell_fprintf(sh, SHELL_INFO, "Partition %d\n", n);
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Entry");
+  if (p.type == 0xEE)
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "GPT '%s'", p.name);
+  else if (p.type)
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "MBR type 0x%02X", p.type);
+  else
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "whole card");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, ", %u + %u blocks\n", p.start, p.size);
+
+  print_offset("Start", p.start, g.erase_blocks, g.au_blocks);
+
+  if (probe_fs(p, fs))
+    return;
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "File system");
+  if (fs.cluster > 1)
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%s, %u KB clusters\n", fs.name, fs.cluster / 2);
+  else
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%s\n", fs.name);
+
+  u32 data = p.start + fs.data_off;
+
+  if (fs.data_off)
+    print_offset("Data region", data, g.erase_blocks, g.au_blocks);
+
+  if (fs.cluster > 1)
+  {
+    // Each cluster crossing an erase sector border costs the card two partial sector updates
+    u32 cross = straddle_permille(data, fs.cluster, g.erase_blocks);
+    shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Clusters across ES");
+    shell_fprintf(sh, cross ? SHELL_WARNING : SHELL_VT100_COLOR_WHITE, "%u.%u %%\n", cross / 10, cross % 10);
+  }
+
+  // A write inside one unit costs one partial unit update, one crossing a unit border
+  // costs two: WAF = 1 + share of writes crossing a border. Given for single-cluster
+  // writes and for AU-sized sequential writes from the data region on.
+  bool aligned = !(data % unit);
+  u32 waf_cl = 1000 + straddle_permille(data, fs.cluster, unit);
+  u32 waf_au = 1000 + straddle_permille(data, unit, unit);
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "WAF estimate");
+  shell_fprintf(sh, aligned ? SHELL_VT100_COLOR_WHITE : SHELL_WARNING, "%u.%02u cluster writes, %u.%02u AU writes%s\n",
+                waf_cl / 1000, waf_cl % 1000 / 10, waf_au / 1000, waf_au % 1000 / 10,
+                aligned ? "" : " - MISALIGNED");
+
+  if (!aligned && p.type)
+  {
+    u32 fix = (data + unit - 1) / unit * unit - fs.data_off;
+
+    shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Aligned start");
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "block %u (same layout)\n", fix);
+  }
+}
+
+// ----- Shell command
+
+int cmd_align(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+  uint64_t size_mb;
+  uint32_t block_count;
+  uint32_t block_size;
+  int rc;
+
+  rc = disk_info(size_mb, block_count, block_size);
+  if (rc) return rc;
+
+  const sd_geom &g = sd_get_geom();
+
+  sd_buf b;
+  if (!b.p) return -ENOMEM;
+  align_buf = b.p;
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Erase sector");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u KB\n", g.erase_blocks / 2);
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "AU size");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, g.au_blocks ? "%u KB\n" : "not defined\n", g.au_blocks / 2);
+
+  part_count = 0;
+  rc = scan_mbr(block_count);
+  if (rc) return rc;
+
+  if (!part_count)
+  {
+    shell_fprintf(sh, SHELL_WARNING, "No partitions found\n");
+    return 0;
+  }
+
+  for (int i = 0; i < part_count; i++)
+    analyze(i + 1, parts[i], g);
+
+  return 0;
+}
+
+SHELL_CMD_ARG_REGISTER(align, NULL, "Check partition/file system alignment to AU and erase sector", cmd_align, 1, 0);
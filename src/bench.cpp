@@ -0,0 +1,189 @@
+
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sd/sd_spec.h>
+
+#include "types.h"
+#include "sdtool.h"
+
+// ----- Throughput / latency benchmark over the sd_cmd() data path
+
+struct bench_stat
+{
+  u32 ops;
+  u32 min_us;
+  u32 max_us;
+  u64 sum_us;
+};
+
+static void bench_add(bench_stat &st, u32 t0)
+{
+  u32 us = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
+
+  st.ops++;
+  st.sum_us += us;
+  st.min_us = _min(st.min_us, us);
+  st.max_us = _max(st.max_us, us);
+}
+
+static void bench_report(const char *what, const bench_stat &st, s64 ms, u64 bytes)
+{
+  if (!st.ops)
+    return;
+
+  ms = _max(ms, 1);
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", what);
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u ops in %u ms", st.ops, (u32)ms);
+
+  if (bytes)
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, ", %u KB/s", (u32)(bytes * 1000 / 1024 / ms));
+
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, ", avg %u us, min %u us, max %u us\n",
+                (u32)(st.sum_us / st.ops), st.min_us, st.max_us);
+}
+
+static int bench_args(size_t argc, char **argv, u32 block_count, u32 &start, u32 &count, u32 &per_op)
+{
+  start  = (argc > 1) ? strtoul(argv[1], NULL, 0) : 0;
+  count  = (argc > 2) ? strtoul(argv[2], NULL, 0) : 2048;
+  per_op = (argc > 3) ? strtoul(argv[3], NULL, 0) : 1;
+
+  if (start >= block_count || count > block_count - start)
+  {
+    shell_fprintf(sh, SHELL_ERROR, "Range %u+%u is beyond %u blocks\n", start, count, block_count);
+    return -EINVAL;
+  }
+
+  if (!per_op || per_op > SD_BUF_BLOCKS)
+  {
+    shell_fprintf(sh, SHELL_ERROR, "Blocks per operation must be 1..%u\n", SD_BUF_BLOCKS);
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+int cmd_bench_read(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+  uint64_t size_mb;
+  uint32_t block_count;
+  uint32_t block_size;
+  u32 start, count, per_op;
+  int rc;
+
+  rc = disk_info(size_mb, block_count, block_size);
+  if (rc) return rc;
+
+  rc = bench_args(argc, argv, block_count, start, count, per_op);
+  if (rc) return rc;
+
+  sd_buf b;
+  if (!b.p) return -ENOMEM;
+
+  bench_stat st = { 0, UINT32_MAX, 0, 0 };
+  s64 t = k_uptime_get();
+
+  for (u32 i = 0; i < count; i += per_op)
+  {
+    u32 n = _min(per_op, count - i);
+    u32 t0 = k_cycle_get_32();
+    rc = sd_read_blocks(start + i, n, b.p);
+    if (rc)
+    {
+      shell_print(sh, "Read %u+%u, rc %d", start + i, n, rc);
+      return rc;
+    }
+    bench_add(st, t0);
+  }
+
+  bench_report("Read", st, k_uptime_get() - t, (u64)count * SDMMC_DEFAULT_BLOCK_SIZE);
+  return 0;
+}
+
+int cmd_bench_write(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+  uint64_t size_mb;
+  uint32_t block_count;
+  uint32_t block_size;
+  u32 start, count, per_op;
+  int rc;
+
+  rc = disk_info(size_mb, block_count, block_size);
+  if (rc) return rc;
+
+  rc = bench_args(argc, argv, block_count, start, count, per_op);
+  if (rc) return rc;
+
+  sd_buf b;
+  if (!b.p) return -ENOMEM;
+
+  shell_fprintf(sh, SHELL_WARNING, "Overwriting blocks %u..%u\n", start, start + count - 1);
+
+  bench_stat st = { 0, UINT32_MAX, 0, 0 };
+  s64 t = k_uptime_get();
+
+  for (u32 i = 0; i < count; i += per_op)
+  {
+    u32 n = _min(per_op, count - i);
+    u32 *w = (u32 *)b.p;
+    for (u32 k = 0; k < n; k++)
+      for (u32 j = 0; j < SDMMC_DEFAULT_BLOCK_SIZE / 4; j++)
+        *w++ = bench_pattern(start + i + k, j);
+
+    u32 t0 = k_cycle_get_32();
+    rc = sd_write_blocks(start + i, n, b.p);
+    if (rc)
+    {
+      shell_print(sh, "Write %u+%u, rc %d", start + i, n, rc);
+      return rc;
+    }
+    bench_add(st, t0);
+  }
+
+  bench_report("Write", st, k_uptime_get() - t, (u64)count * SDMMC_DEFAULT_BLOCK_SIZE);
+  return 0;
+}
+
+int cmd_bench_cmd(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+  uint64_t size_mb;
+  uint32_t block_count;
+  uint32_t block_size;
+  int rc;
+
+  rc = disk_info(size_mb, block_count, block_size);
+  if (rc) return rc;
+
+  u32 count = (argc > 1) ? strtoul(argv[1], NULL, 0) : 1000;
+  bench_stat st = { 0, UINT32_MAX, 0, 0 };
+  s64 t = k_uptime_get();
+
+  for (u32 i = 0; i < count; i++)
+  {
+    u32 t0 = k_cycle_get_32();
+    rc = sd_cmd(SD_SEND_STATUS, 0, SD_SPI_RSP_TYPE_R2);
+    if (rc)
+    {
+      shell_print(sh, "SD_SEND_STATUS, rc %d", rc);
+      return rc;
+    }
+    bench_add(st, t0);
+  }
+
+  bench_report("CMD13 round trip", st, k_uptime_get() - t, 0);
+  return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_bench,
+  SHELL_CMD_ARG(read,  NULL, "Sequential read: [start] [count] [blocks per op]", cmd_bench_read, 1, 3),
+  SHELL_CMD_ARG(write, NULL, "Sequential write (destructive!): [start] [count] [blocks per op]", cmd_bench_write, 1, 3),
+  SHELL_CMD_ARG(cmd,   NULL, "Command round trip: [count]", cmd_bench_cmd, 1, 1),
+  SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(bench, &sub_bench, "Throughput and latency benchmark", NULL);
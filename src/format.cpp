@@ -0,0 +1,544 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sd/sd_spec.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "types.h"
+#include "sdtool.h"
+
+// ----- SD Association-style formatter (SD Physical Layer Part 2, File System Specification)
+//
+// Partition start, FAT region end and cluster heap are placed on Boundary Unit (BU)
+// borders, BU being a multiple of the card's AU and erase sector, so that every cluster
+// write lands inside one flash AU and never straddles two of them.
+
+#define BLK SDMMC_DEFAULT_BLOCK_SIZE
+
+static u8 *fmt_buf;  // pool buffer, SD_BUF_BLOCKS long
+
+struct fmt_layout
+{
+  bool exfat;
+  u32  part_start;   // blocks from card start
+  u32  part_size;    // blocks
+  u32  bu;           // boundary unit, blocks
+  u32  spc;          // sectors per cluster
+  u32  fat_offset;   // from partition start (FAT32: reserved sector count)
+  u32  fat_len;      // per FAT
+  u32  heap_offset;  // from partition start (FAT32: data area)
+  u32  clusters;
+  u32  serial;
+};
+
+static bool fmt_dry;     // -n: print the layout only
+static bool fmt_zeroed;  // card was erased to 0x00, zero fill can be skipped
+
+// SD spec cluster and BU sizes by card capacity (in 512-byte blocks)
+static const struct
+{
+  u32 max_blocks;
+  u16 spc;
+  u32 bu;
+}
+fmt_table[] =
+{
+  { 16 * 1024,       16,     16 },  // <= 8 MB
+  { 128 * 1024,      32,     32 },  // <= 64 MB
+  { 512 * 1024,      32,     64 },  // <= 256 MB
+  { 2 * 1024 * 1024, 32,    128 },  // <= 1 GB
+  { 4 * 1024 * 1024, 64,    128 },  // <= 2 GB
+  { 0x4000000,       64,   8192 },  // <= 32 GB (SDHC)
+  { 0x10000000,     256,  32768 },  // <= 128 GB
+  { 0x40000000,     256,  65536 },  // <= 512 GB
+  { 0xFFFFFFFF,     256, 131072 },  // <= 2 TB
+};
+
+static u32 round_up(u32 v, u32 a)
+{
+  return (v + a - 1) / a * a;
+}
+
+// Smallest multiple of 'bu' that is also a multiple of 'unit' (AU sizes of 12/24 MB are not powers of 2)
+static u32 bu_extend(u32 bu, u32 unit)
+{
+  if (!unit) return bu;
+
+  u32 b = bu;
+  while (b % unit) b += bu;
+  return b;
+}
+
+static int fmt_plan(fmt_layout &l, u32 block_count, const sd_geom &g)
+{
+  int i = 0;
+  while (block_count > fmt_table[i].max_blocks) i++;
+
+  l.spc = fmt_table[i].spc;
+  l.bu  = bu_extend(bu_extend(fmt_table[i].bu, g.au_blocks), g.erase_blocks);
+
+  if (!l.exfat && l.spc > 64)
+    l.spc = 64;  // FAT32 on SDXC: 32 KB clusters
+
+  if (block_count < 2 * l.bu)
+    return -EINVAL;
+
+  l.part_start = l.bu;
+  l.part_size  = block_count - l.part_start;
+
+  u32 ts = l.part_size;
+
+  if (l.exfat)
+  {
+    // FAT in the first half of a BU, cluster heap on the next BU border
+    l.fat_offset  = _max(l.bu / 2, 24u);
+    l.fat_len     = ((ts - l.fat_offset) / l.spc + 2 + BLK / 4 - 1) / (BLK / 4);
+    l.heap_offset = round_up(l.fat_offset + l.fat_len, l.bu);
+    if (l.heap_offset >= ts) return -EINVAL;
+    l.clusters    = (ts - l.heap_offset) / l.spc;
+  }
+  else
+  {
+    // Need at least 65525 clusters to be FAT32
+    for (;;)
+    {
+      // FAT size for the whole partition is an upper bound of the final one
+      l.fat_len = (ts / l.spc + 2 + BLK / 4 - 1) / (BLK / 4);
+
+      // Reserved sectors pad the FATs up to a BU border (boot, FSInfo and backups at 0/1/6/7)
+      l.fat_offset = l.bu - (2 * l.fat_len) % l.bu;
+      while (l.fat_offset < 8) l.fat_offset += l.bu;
+
+      // BPB_RsvdSecCnt is 16 bits, padding up to a 64 MB BU (SDXC AU) may not fit
+      if (l.fat_offset > 0xFFFF) return -ERANGE;
+
+      l.heap_offset = l.fat_offset + 2 * l.fat_len;
+      if (l.heap_offset >= ts) return -EINVAL;
+      l.clusters = (ts - l.heap_offset) / l.spc;
+
+      if (l.clusters >= 65525) break;
+      if (l.spc == 1) return -EINVAL;
+      l.spc >>= 1;
+    }
+  }
+
+  return 0;
+}
+
+static void fmt_print(const fmt_layout &l)
+{
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "File system");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%s\n", l.exfat ? "exFAT" : "FAT32");
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Boundary unit");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u blocks (%u KB)\n", l.bu, l.bu / 2);
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Partition");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u + %u blocks\n", l.part_start, l.part_size);
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Cluster size");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u KB\n", l.spc / 2);
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "FAT");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u x %u blocks at %u\n", l.exfat ? 1 : 2, l.fat_len, l.part_start + l.fat_offset);
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Cluster heap");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u clusters at %u\n", l.clusters, l.part_start + l.heap_offset);
+}
+
+// ----- Block output
+
+static int fmt_write(u32 lba, const u8 *buf)
+{
+  if (fmt_dry) return 0;
+
+  int rc = sd_write_block(lba, buf);
+  if (rc)
+    shell_print(sh, "SD_WRITE_SINGLE_BLOCK %u, rc %d", lba, rc);
+
+  return rc;
+}
+
+static int fmt_zero(u32 lba, u32 count)
+{
+  if (fmt_zeroed || fmt_dry) return 0;
+
+  memset(fmt_buf, 0, SD_BUF_BLOCKS * BLK);
+
+  for (u32 i = 0; i < count; i += SD_BUF_BLOCKS)
+  {
+    u32 n = _min((u32)SD_BUF_BLOCKS, count - i);
+
+    int rc = sd_write_blocks(lba + i, n, fmt_buf);
+    if (rc)
+    {
+      shell_print(sh, "Write %u+%u, rc %d", lba + i, n, rc);
+      return rc;
+    }
+  }
+
+  return 0;
+}
+
+static void lba_chs(u8 *p, u32 lba)
+{
+  u32 c = lba / (255 * 63);
+
+  if (c > 1023)
+  {
+    p[0] = 0xFE; p[1] = 0xFF; p[2] = 0xFF;
+    return;
+  }
+
+  p[0] = (lba / 63) % 255;
+  p[1] = ((lba % 63) + 1) | ((c >> 2) & 0xC0);
+  p[2] = c;
+}
+
+static int fmt_mbr(const fmt_layout &l)
+{
+  memset(fmt_buf, 0, BLK);
+
+  sys_put_le32(l.serial, &fmt_buf[440]);
+
+  u8 *p = &fmt_buf[446];
+  p[0] = 0x00;
+  lba_chs(&p[1], l.part_start);
+  p[4] = l.exfat ? 0x07 : 0x0C;
+  lba_chs(&p[5], l.part_start + l.part_size - 1);
+  sys_put_le32(l.part_start, &p[8]);
+  sys_put_le32(l.part_size, &p[12]);
+
+  fmt_buf[510] = 0x55;
+  fmt_buf[511] = 0xAA;
+
+  return fmt_write(0, fmt_buf);
+}
+
+// ----- FAT32
+
+static void fat32_boot(const fmt_layout &l)
+{
+  memset(fmt_buf, 0, BLK);
+
+  memcpy(&fmt_buf[0], "\xEB\x58\x90" "MSDOS5.0", 11);
+  sys_put_le16(BLK, &fmt_buf[11]);
+  fmt_buf[13] = l.spc;
+  sys_put_le16(l.fat_offset, &fmt_buf[14]);
+  fmt_buf[16] = 2;                             // FATs
+  fmt_buf[21] = 0xF8;                          // media
+  sys_put_le16(63, &fmt_buf[24]);              // sectors per track
+  sys_put_le16(255, &fmt_buf[26]);             // heads
+  sys_put_le32(l.part_start, &fmt_buf[28]);    // hidden sectors
+  sys_put_le32(l.part_size, &fmt_buf[32]);
+  sys_put_le32(l.fat_len, &fmt_buf[36]);
+  sys_put_le32(2, &fmt_buf[44]);               // root directory cluster
+  sys_put_le16(1, &fmt_buf[48]);               // FSInfo sector
+  sys_put_le16(6, &fmt_buf[50]);               // backup boot sector
+  fmt_buf[64] = 0x80;                          // drive number
+  fmt_buf[66] = 0x29;                          // extended boot signature
+  sys_put_le32(l.serial, &fmt_buf[67]);
+  memcpy(&fmt_buf[71], "NO NAME    " "FAT32   ", 19);
+  fmt_buf[510] = 0x55;
+  fmt_buf[511] = 0xAA;
+}
+
+static void fat32_fsinfo(const fmt_layout &l)
+{
+  memset(fmt_buf, 0, BLK);
+
+  sys_put_le32(0x41615252, &fmt_buf[0]);
+  sys_put_le32(0x61417272, &fmt_buf[484]);
+  sys_put_le32(l.clusters - 1, &fmt_buf[488]);  // free clusters (root uses one)
+  sys_put_le32(3, &fmt_buf[492]);               // next free hint
+  sys_put_le32(0xAA550000, &fmt_buf[508]);
+}
+
+static int fmt_fat32(const fmt_layout &l)
+{
+  u32 base = l.part_start;
+  int rc;
+
+  shell_print(sh, "Writing FATs");
+
+  for (int f = 0; f < 2; f++)
+  {
+    u32 fat = base + l.fat_offset + f * l.fat_len;
+
+    memset(fmt_buf, 0, BLK);
+    sys_put_le32(0x0FFFFFF8, &fmt_buf[0]);
+    sys_put_le32(0x0FFFFFFF, &fmt_buf[4]);
+    sys_put_le32(0x0FFFFFFF, &fmt_buf[8]);  // root directory, one cluster
+    rc = fmt_write(fat, fmt_buf);
+    if (rc) return rc;
+
+    rc = fmt_zero(fat + 1, l.fat_len - 1);
+    if (rc) return rc;
+  }
+
+  rc = fmt_zero(base + l.heap_offset, l.spc);
+  if (rc) return rc;
+
+  shell_print(sh, "Writing boot sectors");
+
+  for (u32 b = 0; b <= 6; b += 6)
+  {
+    fat32_boot(l);
+    rc = fmt_write(base + b, fmt_buf);
+    if (rc) return rc;
+
+    fat32_fsinfo(l);
+    rc = fmt_write(base + b + 1, fmt_buf);
+    if (rc) return rc;
+  }
+
+  return 0;
+}
+
+// ----- exFAT
+
+// Compressed up-case table: identity except 'a'..'z'
+static const u16 exfat_upcase[] =
+{
+  0xFFFF, 0x0061,
+  'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
+  'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
+  0xFFFF, 0xFF85,
+};
+
+static u32 exfat_sum(u32 sum, const u8 *p, u32 n, bool boot)
+{
+  for (u32 i = 0; i < n; i++)
+  {
+    if (boot && (i == 106 || i == 107 || i == 112))  // VolumeFlags, PercentInUse
+      continue;
+
+    sum = ((sum & 1) ? 0x80000000 : 0) + (sum >> 1) + p[i];
+  }
+
+  return sum;
+}
+
+static void exfat_boot(const fmt_layout &l, u32 root)
+{
+  memset(fmt_buf, 0, BLK);
+
+  memcpy(&fmt_buf[0], "\xEB\x76\x90" "EXFAT   ", 11);
+  sys_put_le64(l.part_start, &fmt_buf[64]);
+  sys_put_le64(l.part_size, &fmt_buf[72]);
+  sys_put_le32(l.fat_offset, &fmt_buf[80]);
+  sys_put_le32(l.fat_len, &fmt_buf[84]);
+  sys_put_le32(l.heap_offset, &fmt_buf[88]);
+  sys_put_le32(l.clusters, &fmt_buf[92]);
+  sys_put_le32(root, &fmt_buf[96]);            // root directory cluster
+  sys_put_le32(l.serial, &fmt_buf[100]);
+  sys_put_le16(0x0100, &fmt_buf[104]);         // revision 1.00
+  fmt_buf[108] = 9;                            // bytes per sector shift
+  fmt_buf[109] = __builtin_ctz(l.spc);         // sectors per cluster shift
+  fmt_buf[110] = 1;                            // FATs
+  fmt_buf[111] = 0x80;                         // drive select
+  fmt_buf[510] = 0x55;
+  fmt_buf[511] = 0xAA;
+}
+
+static int exfat_boot_region(const fmt_layout &l, u32 lba, u32 root)
+{
+  u32 sum = 0;
+  int rc;
+
+  for (u32 s = 0; s < 11; s++)
+  {
+    if (s == 0)
+      exfat_boot(l, root);
+    else
+    {
+      memset(fmt_buf, 0, BLK);
+      if (s <= 8)
+        sys_put_le32(0xAA550000, &fmt_buf[508]);  // extended boot sectors
+    }
+
+    sum = exfat_sum(sum, fmt_buf, BLK, s == 0);
+    rc = fmt_write(lba + s, fmt_buf);
+    if (rc) return rc;
+  }
+
+  for (u32 i = 0; i < BLK / 4; i++)
+    sys_put_le32(sum, &fmt_buf[i * 4]);
+
+  return fmt_write(lba + 11, fmt_buf);
+}
+
+static u32 clus_lba(const fmt_layout &l, u32 c)
+{
+  return l.part_start + l.heap_offset + (c - 2) * l.spc;
+}
+
+static int fmt_exfat(const fmt_layout &l)
+{
+  u32 base = l.part_start;
+  u32 clus_bytes = l.spc * BLK;
+  u32 bm_bytes = (l.clusters + 7) / 8;
+  u32 bm_clus = (bm_bytes + clus_bytes - 1) / clus_bytes;
+  u32 up_clus = 2 + bm_clus;
+  u32 root_clus = up_clus + 1;
+  u32 used = bm_clus + 2;
+  int rc;
+
+  if (root_clus + 1 > BLK / 4 || used > BLK * 8)
+    return -EINVAL;
+
+  shell_print(sh, "Writing FAT");
+
+  memset(fmt_buf, 0, BLK);
+  sys_put_le32(0xFFFFFFF8, &fmt_buf[0]);
+  sys_put_le32(0xFFFFFFFF, &fmt_buf[4]);
+  for (u32 c = 2; c < up_clus; c++)
+    sys_put_le32((c + 1 < up_clus) ? c + 1 : 0xFFFFFFFF, &fmt_buf[c * 4]);
+  sys_put_le32(0xFFFFFFFF, &fmt_buf[up_clus * 4]);
+  sys_put_le32(0xFFFFFFFF, &fmt_buf[root_clus * 4]);
+  rc = fmt_write(base + l.fat_offset, fmt_buf);
+  if (rc) return rc;
+
+  rc = fmt_zero(base + l.fat_offset + 1, l.fat_len - 1);
+  if (rc) return rc;
+
+  shell_print(sh, "Writing allocation bitmap");
+
+  memset(fmt_buf, 0, BLK);
+  for (u32 i = 0; i < used; i++)
+    fmt_buf[i / 8] |= 1 << (i % 8);
+  rc = fmt_write(clus_lba(l, 2), fmt_buf);
+  if (rc) return rc;
+
+  rc = fmt_zero(clus_lba(l, 2) + 1, (bm_bytes + BLK - 1) / BLK - 1);
+  if (rc) return rc;
+
+  memset(fmt_buf, 0, BLK);
+  for (u32 i = 0; i < countof(exfat_upcase); i++)
+    sys_put_le16(exfat_upcase[i], &fmt_buf[i * 2]);
+  u32 up_sum = exfat_sum(0, fmt_buf, sizeof(exfat_upcase), false);
+  rc = fmt_write(clus_lba(l, up_clus), fmt_buf);
+  if (rc) return rc;
+
+  shell_print(sh, "Writing root directory");
+
+  rc = fmt_zero(clus_lba(l, root_clus) + 1, l.spc - 1);
+  if (rc) return rc;
+
+  memset(fmt_buf, 0, BLK);
+  u8 *e = &fmt_buf[0];
+  e[0] = 0x81;                                 // allocation bitmap
+  sys_put_le32(2, &e[20]);
+  sys_put_le64(bm_bytes, &e[24]);
+  e += 32;
+  e[0] = 0x82;                                 // up-case table
+  sys_put_le32(up_sum, &e[4]);
+  sys_put_le32(up_clus, &e[20]);
+  sys_put_le64(sizeof(exfat_upcase), &e[24]);
+  rc = fmt_write(clus_lba(l, root_clus), fmt_buf);
+  if (rc) return rc;
+
+  shell_print(sh, "Writing boot regions");
+
+  rc = exfat_boot_region(l, base + 12, root_clus);
+  if (rc) return rc;
+
+  return exfat_boot_region(l, base, root_clus);
+}
+
+// ----- Shell command
+
+int cmd_format(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+  uint64_t size_mb;
+  uint32_t block_count;
+  uint32_t block_size;
+  bool erase = false;
+  int fs = -1;
+  int rc;
+
+  fmt_dry = false;
+
+  for (size_t i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-e"))
+      erase = true;
+    else if (!strcmp(argv[i], "-n"))
+      fmt_dry = true;
+    else if (!strcmp(argv[i], "fat32"))
+      fs = 0;
+    else if (!strcmp(argv[i], "exfat"))
+      fs = 1;
+    else
+    {
+      shell_fprintf(sh, SHELL_ERROR, "Unknown argument '%s'\n", argv[i]);
+      return -EINVAL;
+    }
+  }
+
+  rc = disk_info(size_mb, block_count, block_size);
+  if (rc) return rc;
+
+  const sd_geom &g = sd_get_geom();
+
+  sd_buf b;
+  if (!b.p) return -ENOMEM;
+  fmt_buf = b.p;
+
+  fmt_layout l;
+  memset(&l, 0, sizeof(l));
+  l.exfat  = (fs < 0) ? (block_count > 0x4000000) : fs;  // SDXC (> 32 GB) gets exFAT
+  l.serial = k_cycle_get_32() ^ (u32)k_uptime_get();
+
+  rc = fmt_plan(l, block_count, g);
+  if (rc == -ERANGE)
+  {
+    shell_fprintf(sh, SHELL_ERROR, "BU of %u KB cannot be aligned with FAT32 reserved sectors, use exfat\n", l.bu / 2);
+    return -EINVAL;
+  }
+  if (rc)
+  {
+    shell_fprintf(sh, SHELL_ERROR, "Card too small for %s\n", l.exfat ? "exFAT" : "FAT32");
+    return rc;
+  }
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "AU size");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, g.au_blocks ? "%u KB\n" : "not defined\n", g.au_blocks / 2);
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Erase sector");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u KB\n", g.erase_blocks / 2);
+  fmt_print(l);
+
+  if (fmt_dry)
+    return 0;
+
+  fmt_zeroed = false;
+
+  if (erase)
+  {
+    shell_fprintf(sh, SHELL_WARNING, "Erasing SD card\n");
+    rc = sd_erase(0, block_count - 1);
+    shell_print(sh, "Erase, rc %d", rc);
+    if (rc) return rc;
+
+    fmt_zeroed = !g.erase_ones;
+  }
+
+  shell_fprintf(sh, SHELL_WARNING, "Formatting SD card\n");
+  s64 t = k_uptime_get();
+
+  // Drop the old partition table first, it must not point at half-written structures
+  rc = fmt_zero(0, 1);
+  if (rc) return rc;
+
+  rc = l.exfat ? fmt_exfat(l) : fmt_fat32(l);
+  if (rc) return rc;
+
+  // Partition table goes last so an interrupted format never looks valid
+  rc = fmt_mbr(l);
+  if (rc) return rc;
+
+  shell_print(sh, "Done in %u ms", (u32)(k_uptime_get() - t));
+  return 0;
+}
+
+SHELL_CMD_ARG_REGISTER(format, NULL,
+  "Format with AU-aligned layout: [-e] erase first, [-n] dry run, [fat32|exfat]",
+  cmd_format, 1, 3);
@@ -0,0 +1,52 @@
+
+#include <zephyr/kernel.h>
+#include <zephyr/sd/sd_spec.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/__assert.h>
+
+#include "types.h"
+#include "sdtool.h"
+
+// ----- Static I/O buffer pool
+//
+// Fixed number of block-sized buffers, claimed with a CAS on a bitmap so any thread
+// can take or return one without locking. Nothing on the data path allocates or copies.
+
+#define POOL_BUFS  CONFIG_SDTOOL_POOL_BUFS
+#define POOL_BYTES (SD_BUF_BLOCKS * SDMMC_DEFAULT_BLOCK_SIZE)
+
+#if defined(CONFIG_SDHC_BUFFER_ALIGNMENT) && CONFIG_SDHC_BUFFER_ALIGNMENT > 4
+#define POOL_ALIGN CONFIG_SDHC_BUFFER_ALIGNMENT
+#else
+#define POOL_ALIGN 4
+#endif
+
+BUILD_ASSERT(POOL_BUFS <= 32, "pool bitmap is one atomic_t");
+
+static u8 pool_mem[POOL_BUFS][POOL_BYTES] __aligned(POOL_ALIGN);
+static atomic_t pool_map;
+
+u8 *sd_buf_get()
+{
+  for (;;)
+  {
+    atomic_val_t m = atomic_get(&pool_map);
+
+    int i = 0;
+    while (i < POOL_BUFS && (m & BIT(i))) i++;
+
+    if (i == POOL_BUFS)
+      return NULL;
+
+    if (atomic_cas(&pool_map, m, m | BIT(i)))
+      return pool_mem[i];
+  }
+}
+
+void sd_buf_put(u8 *buf)
+{
+  u32 i = (buf - pool_mem[0]) / POOL_BYTES;
+
+  __ASSERT(i < POOL_BUFS && buf == pool_mem[i], "not a pool buffer");
+  atomic_and(&pool_map, ~BIT(i));
+}
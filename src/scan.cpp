@@ -0,0 +1,454 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sd/sd_spec.h>
+#include <zephyr/sys/crc.h>
+
+#ifdef CONFIG_SDTOOL_SCAN_CORE1
+#include <hardware/structs/psm.h>
+#include <hardware/structs/scb.h>
+#include <hardware/structs/sio.h>
+#include <hardware/structs/timer.h>
+#include <hardware/sync.h>
+#endif
+
+#include "types.h"
+#include "sdtool.h"
+
+// ----- Dual-core read-and-check pipeline
+//
+// The firmware runs on core 0 of the RP2040 only. For 'scan', core 0 just moves data off
+// the card while core 1 - started bare-metal through the bootrom FIFO handshake, outside
+// the kernel - compares and hashes it (pattern compare, CRC32). Filled pool buffers travel
+// through a single-producer/single-consumer ring; each core owns one index and sleeps in
+// WFE while the ring is full or empty until the other core's SEV, so there are no locks
+// and no spinning. Without a second core (native_sim) scan runs serially.
+
+#define BLK         SDMMC_DEFAULT_BLOCK_SIZE
+#define SCAN_CHUNK  SD_BUF_BLOCKS
+
+struct scan_slot
+{
+  u8 *buf;
+  u32 lba;
+  u32 count;
+};
+
+static scan_slot scan_slots[CONFIG_SDTOOL_POOL_BUFS];
+static u32 scan_bufs;        // ring size: pool buffers borrowed
+
+static u32 scan_start, scan_count;
+
+enum scan_mode
+{
+  SCAN_HASH,
+  SCAN_VERIFY,
+};
+
+struct scan_result
+{
+  u32 crc;
+  u32 bad_blocks;
+  u32 first_bad;
+  u32 read_us;    // core 0 in sd_read_blocks()
+  u32 work_us;    // time in the check
+  u32 wait_us;    // dual-core: check waiting for data
+  u32 stall_us;   // dual-core: reader waiting for a free buffer
+  int rc;
+};
+
+// ----- Time base, readable from both cores
+
+#ifdef CONFIG_SDTOOL_SCAN_CORE1
+// 1 MHz system timer: SysTick is per core and core 1 has none running
+static inline u32 scan_now() { return timer_hw->timerawl; }
+static inline u32 scan_us(u32 d) { return d; }
+#else
+static inline u32 scan_now() { return k_cycle_get_32(); }
+static inline u32 scan_us(u32 d) { return k_cyc_to_us_floor32(d); }
+#endif
+
+// ----- Check, runs on either core
+
+static void scan_check(scan_mode mode, const u8 *buf, u32 lba, u32 count, scan_result &res)
+{
+  for (u32 i = 0; i < count; i++)
+  {
+    const u8 *b = buf + i * BLK;
+
+    if (mode == SCAN_VERIFY)
+    {
+      const u32 *w = (const u32 *)b;
+
+      for (u32 j = 0; j < BLK / 4; j++)
+      {
+        if (w[j] != bench_pattern(lba + i, j))
+        {
+          if (!res.bad_blocks++)
+            res.first_bad = lba + i;
+          break;
+        }
+      }
+    }
+
+    res.crc = crc32_ieee_update(res.crc, b, BLK);
+  }
+}
+
+// ----- Serial, one core
+
+static void scan_serial(scan_mode mode, scan_result &res)
+{
+  u8 *buf = scan_slots[0].buf;
+
+  for (u32 lba = scan_start; lba < scan_start + scan_count; lba += SCAN_CHUNK)
+  {
+    u32 n = _min((u32)SCAN_CHUNK, scan_start + scan_count - lba);
+
+    u32 t = scan_now();
+    res.rc = sd_read_blocks(lba, n, buf);
+    res.read_us += scan_us(scan_now() - t);
+
+    if (res.rc)
+    {
+      shell_print(sh, "Read %u+%u, rc %d", lba, n, res.rc);
+      return;
+    }
+
+    t = scan_now();
+    scan_check(mode, buf, lba, n, res);
+    res.work_us += scan_us(scan_now() - t);
+  }
+}
+
+#ifdef CONFIG_SDTOOL_SCAN_CORE1
+
+// ----- Consumer (core 1)
+
+static volatile u32 scan_head;   // written by core 0 only
+static volatile u32 scan_tail;   // written by core 1 only
+static volatile u32 scan_stop;   // core 0: no more chunks will be published
+static volatile u32 scan_done;   // core 1: finished, scan_core1_res is valid
+
+static u32 scan_chunks;
+static scan_mode scan_core1_mode;
+static scan_result scan_core1_res;
+
+static u32 scan_core1_stack[256] __aligned(8);
+
+// No kernel services here: no logging, no kernel calls, interrupts are not set up
+static void scan_core1()
+{
+  scan_result &res = scan_core1_res;
+
+  for (u32 tail = 0; tail < scan_chunks; )
+  {
+    u32 t = scan_now();
+    while (scan_head == tail && !scan_stop)
+      __wfe();
+    res.wait_us += scan_us(scan_now() - t);
+
+    // Reader stopped on an error
+    if (scan_head == tail)
+      break;
+
+    __dmb();
+    const scan_slot &s = scan_slots[tail % scan_bufs];
+
+    t = scan_now();
+    scan_check(scan_core1_mode, s.buf, s.lba, s.count, res);
+    res.work_us += scan_us(scan_now() - t);
+
+    // Done with the buffer, give it back
+    __dmb();
+    scan_tail = ++tail;
+    __sev();
+  }
+
+  __dmb();
+  scan_done = 1;
+  __sev();
+
+  for (;;)
+    __wfe();
+}
+
+// ----- Core 1 control
+
+static void scan_fifo_push(u32 v)
+{
+  while (!(sio_hw->fifo_st & SIO_FIFO_ST_RDY_BITS))
+    ;
+  sio_hw->fifo_wr = v;
+  __sev();
+}
+
+static u32 scan_fifo_pop()
+{
+  while (!(sio_hw->fifo_st & SIO_FIFO_ST_VLD_BITS))
+    __wfe();
+  return sio_hw->fifo_rd;
+}
+
+// Holds core 1 in reset (powered off) until the next launch
+static void scan_core1_off()
+{
+  hw_set_bits(&psm_hw->frce_off, PSM_FRCE_OFF_PROC1_BITS);
+  while (!(psm_hw->frce_off & PSM_FRCE_OFF_PROC1_BITS))
+    ;
+}
+
+// Bootrom launch protocol (RP2040 datasheet 2.8.2): core 1 echoes every word, a wrong
+// echo restarts the sequence
+static void scan_core1_launch()
+{
+  scan_core1_off();
+  hw_clear_bits(&psm_hw->frce_off, PSM_FRCE_OFF_PROC1_BITS);
+  scan_fifo_pop();  // bootrom sends 0 when it is up
+
+  const u32 seq[] =
+  {
+    0, 0, 1,
+    scb_hw->vtor,
+    (u32)(uintptr_t)(scan_core1_stack + countof(scan_core1_stack)),
+    (u32)(uintptr_t)scan_core1,
+  };
+
+  for (u32 i = 0; i < countof(seq); )
+  {
+    // Drain what core 1 sent before a 0, it may be waiting for FIFO space
+    if (!seq[i])
+    {
+      while (sio_hw->fifo_st & SIO_FIFO_ST_VLD_BITS)
+        (void)sio_hw->fifo_rd;
+      __sev();
+    }
+
+    scan_fifo_push(seq[i]);
+    i = (scan_fifo_pop() == seq[i]) ? i + 1 : 0;
+  }
+}
+
+// ----- Producer (core 0, shell thread)
+
+static void scan_dual(scan_mode mode, scan_result &res)
+{
+  scan_head = scan_tail = scan_stop = scan_done = 0;
+  scan_chunks = (scan_count + SCAN_CHUNK - 1) / SCAN_CHUNK;
+  scan_core1_mode = mode;
+  memset(&scan_core1_res, 0, sizeof(scan_core1_res));
+  __dmb();
+
+  scan_core1_launch();
+
+  u32 head = 0;
+
+  for (u32 lba = scan_start; lba < scan_start + scan_count; lba += SCAN_CHUNK)
+  {
+    // Wait for core 1 to free a slot
+    u32 t = scan_now();
+    while (head - scan_tail >= scan_bufs)
+      __wfe();
+    res.stall_us += scan_us(scan_now() - t);
+
+    scan_slot &s = scan_slots[head % scan_bufs];
+    s.lba   = lba;
+    s.count = _min((u32)SCAN_CHUNK, scan_start + scan_count - lba);
+
+    t = scan_now();
+    res.rc = sd_read_blocks(s.lba, s.count, s.buf);
+    res.read_us += scan_us(scan_now() - t);
+
+    if (res.rc)
+    {
+      shell_print(sh, "Read %u+%u, rc %d", s.lba, s.count, res.rc);
+      break;
+    }
+
+    // Slot contents must be visible before the index that publishes it
+    __dmb();
+    scan_head = ++head;
+    __sev();
+  }
+
+  scan_stop = 1;
+  __sev();
+
+  while (!scan_done)
+    __wfe();
+  __dmb();
+
+  scan_core1_off();
+
+  res.crc        = scan_core1_res.crc;
+  res.bad_blocks = scan_core1_res.bad_blocks;
+  res.first_bad  = scan_core1_res.first_bad;
+  res.work_us    = scan_core1_res.work_us;
+  res.wait_us    = scan_core1_res.wait_us;
+}
+
+#endif  // CONFIG_SDTOOL_SCAN_CORE1
+
+// ----- Shell commands
+
+static u32 scan_run(scan_mode mode, bool dual, scan_result &res)
+{
+  memset(&res, 0, sizeof(res));
+
+  // Borrow every free pool buffer for the ring
+  for (scan_bufs = 0; scan_bufs < countof(scan_slots); scan_bufs++)
+    if (!(scan_slots[scan_bufs].buf = sd_buf_get()))
+      break;
+
+  s64 t = k_uptime_get();
+
+  if (scan_bufs < (dual ? 2u : 1u))
+  {
+    shell_fprintf(sh, SHELL_ERROR, "Not enough free I/O buffers\n");
+    res.rc = -ENOMEM;
+  }
+#ifdef CONFIG_SDTOOL_SCAN_CORE1
+  else if (dual)
+    scan_dual(mode, res);
+#endif
+  else
+    scan_serial(mode, res);
+
+  t = k_uptime_get() - t;
+
+  for (u32 i = 0; i < scan_bufs; i++)
+    sd_buf_put(scan_slots[i].buf);
+
+  return _max(t, 1);
+}
+
+static void scan_report(bool dual, u32 ms, const scan_result &res)
+{
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", dual ? "Dual-core" : "Serial");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u blocks in %u ms, %u KB/s, CRC32 %08X\n",
+                scan_count, ms, (u32)((u64)scan_count * BLK * 1000 / 1024 / ms), res.crc);
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "");
+  if (dual)
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "check %u ms on core 1 (waited %u ms), read %u ms (stalled %u ms)\n",
+                  res.work_us / 1000, res.wait_us / 1000, res.read_us / 1000, res.stall_us / 1000);
+  else
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "check %u ms, read %u ms\n",
+                  res.work_us / 1000, res.read_us / 1000);
+}
+
+static int scan_args(size_t argc, char **argv, bool &dual)
+{
+  uint64_t size_mb;
+  uint32_t block_count;
+  uint32_t block_size;
+  int rc;
+
+  rc = disk_info(size_mb, block_count, block_size);
+  if (rc) return rc;
+
+  dual = IS_ENABLED(CONFIG_SDTOOL_SCAN_CORE1);
+  int n = 0;
+  u32 v[2] = { 0, 2048 };
+
+  for (size_t i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-1"))
+      dual = false;
+    else if (n < 2)
+      v[n++] = strtoul(argv[i], NULL, 0);
+  }
+
+  scan_start = v[0];
+  scan_count = v[1];
+
+  if (!scan_count || scan_start >= block_count || scan_count > block_count - scan_start)
+  {
+    shell_fprintf(sh, SHELL_ERROR, "Range %u+%u is beyond %u blocks\n", scan_start, scan_count, block_count);
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+int cmd_scan_hash(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+  bool dual;
+  scan_result res;
+
+  int rc = scan_args(argc, argv, dual);
+  if (rc) return rc;
+
+  u32 ms = scan_run(SCAN_HASH, dual, res);
+  if (res.rc) return res.rc;
+
+  scan_report(dual, ms, res);
+  return 0;
+}
+
+int cmd_scan_verify(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+  bool dual;
+  scan_result res;
+
+  int rc = scan_args(argc, argv, dual);
+  if (rc) return rc;
+
+  u32 ms = scan_run(SCAN_VERIFY, dual, res);
+  if (res.rc) return res.rc;
+
+  scan_report(dual, ms, res);
+
+  shell_fprintf(sh, SHELL_INFO, "  %-19s: ", "Mismatching blocks");
+  if (res.bad_blocks)
+    shell_fprintf(sh, SHELL_WARNING, "%u, first at %u\n", res.bad_blocks, res.first_bad);
+  else
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "none\n");
+
+  return 0;
+}
+
+int cmd_scan_bench(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+  bool dual;
+  scan_result r1, r2;
+
+  int rc = scan_args(argc, argv, dual);
+  if (rc) return rc;
+
+  if (!IS_ENABLED(CONFIG_SDTOOL_SCAN_CORE1))
+  {
+    shell_fprintf(sh, SHELL_ERROR, "No second core to compare against (RP2040 only)\n");
+    return -ENOTSUP;
+  }
+
+  u32 ms1 = scan_run(SCAN_VERIFY, false, r1);
+  if (r1.rc) return r1.rc;
+  scan_report(false, ms1, r1);
+
+  u32 ms2 = scan_run(SCAN_VERIFY, true, r2);
+  if (r2.rc) return r2.rc;
+  scan_report(true, ms2, r2);
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Speedup");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u.%02u x\n", ms1 / ms2, ms1 * 100 / ms2 % 100);
+
+  if (r1.crc != r2.crc)
+    shell_fprintf(sh, SHELL_ERROR, "CRC mismatch between runs\n");
+
+  return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_scan,
+  SHELL_CMD_ARG(hash,   NULL, "CRC32 of a range: [start] [count] [-1 one core]", cmd_scan_hash, 1, 3),
+  SHELL_CMD_ARG(verify, NULL, "Check 'bench write' pattern: [start] [count] [-1 one core]", cmd_scan_verify, 1, 3),
+  SHELL_CMD_ARG(bench,  NULL, "Serial vs dual-core verify: [start] [count]", cmd_scan_bench, 1, 2),
+  SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(scan, &sub_scan, "Read and check a range, checks on RP2040 core 1 (SPSC ring)", NULL);
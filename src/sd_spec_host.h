@@ -0,0 +1,75 @@
+
+#pragma once
+
+// Host builds (tools/) only: the subset of Zephyr's <zephyr/sd/sd_spec.h>
+// used by sdregs.cpp, with identical names and layout.
+
+#include <stdint.h>
+
+#define SD_PRODUCT_NAME_BYTES    5
+#define SDMMC_DEFAULT_BLOCK_SIZE 512
+
+enum sd_csd_flag
+{
+  SD_CSD_READ_BLK_PARTIAL_FLAG        = (1u << 0),
+  SD_CSD_WRITE_BLK_MISALIGN_FLAG      = (1u << 1),
+  SD_CSD_READ_BLK_MISALIGN_FLAG       = (1u << 2),
+  SD_CSD_DSR_IMPLEMENTED_FLAG         = (1u << 3),
+  SD_CSD_ERASE_BLK_EN_FLAG            = (1u << 4),
+  SD_CSD_WRITE_PROTECT_GRP_EN_FLAG    = (1u << 5),
+  SD_CSD_WRITE_BLK_PARTIAL_FLAG       = (1u << 6),
+  SD_CSD_FILE_FMT_GRP_FLAG            = (1u << 7),
+  SD_CSD_COPY_FLAG                    = (1u << 8),
+  SD_CSD_PERMANENT_WRITE_PROTECT_FLAG = (1u << 9),
+  SD_CSD_TMP_WRITE_PROTECT_FLAG       = (1u << 10),
+};
+
+enum sd_scr_flag
+{
+  SD_SCR_DATA_STATUS_AFTER_ERASE = (1u << 0),
+  SD_SCR_SPEC3                   = (1u << 1),
+};
+
+struct sd_csd
+{
+  uint8_t  csd_structure;
+  uint8_t  read_time1;
+  uint8_t  read_time2;
+  uint8_t  xfer_rate;
+  uint16_t cmd_class;
+  uint8_t  read_blk_len;
+  uint16_t flags;
+  uint32_t device_size;
+  uint8_t  read_current_min;
+  uint8_t  read_current_max;
+  uint8_t  write_current_min;
+  uint8_t  write_current_max;
+  uint8_t  dev_size_mul;
+  uint8_t  erase_size;
+  uint8_t  write_prtect_size;
+  uint8_t  write_speed_factor;
+  uint8_t  write_blk_len;
+  uint8_t  file_fmt;
+};
+
+struct sd_cid
+{
+  uint8_t  manufacturer;
+  uint16_t application;
+  uint8_t  name[SD_PRODUCT_NAME_BYTES];
+  uint8_t  version;
+  uint32_t ser_num;
+  uint16_t date;
+};
+
+struct sd_scr
+{
+  uint8_t  flags;
+  uint8_t  scr_structure;
+  uint8_t  sd_spec;
+  uint8_t  sd_sec;
+  uint8_t  sd_width;
+  uint8_t  sd_ext_sec;
+  uint8_t  cmd_support;
+  uint32_t rsvd;
+};
@@ -0,0 +1,464 @@
+
+// File-backed SD card emulator for native_sim.
+//
+// Presents itself as an SPI-mode SD host with a single SDHC card, so the SD
+// subsystem, disk access and the shell commands run unmodified on the host.
+// Card contents live in a host file (mmap'ed by native/sdcard_file.c),
+// command latency, transfer, program and erase timing follow Kconfig.
+
+#ifdef CONFIG_SDTOOL_SDHC_EMUL
+
+#define DT_DRV_COMPAT sdtool_sdhc_emul
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/sdhc.h>
+#include <zephyr/sd/sd_spec.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include "cmdline.h"
+#include "soc.h"
+#include "sdcard_file.h"
+
+LOG_MODULE_REGISTER(sdhc_emul, CONFIG_SDHC_LOG_LEVEL);
+
+#define BLK_SIZE SDMMC_DEFAULT_BLOCK_SIZE
+
+// SPI R1 bits
+#define R1_IDLE       0x01
+#define R1_ILLEGAL    0x04
+#define R1_ADDR_ERR   0x20
+#define R1_PARAM_ERR  0x40
+
+struct sdhc_emul_data
+{
+  uint8_t *mem;
+  uint32_t blocks;
+  bool idle;
+  bool app_cmd;
+  int init_polls;
+  uint32_t erase_start;
+  uint32_t erase_end;
+  uint32_t written;
+  int64_t busy_until;  // ticks
+
+  uint8_t cid[16];
+  uint8_t csd[16];
+  uint8_t scr[8];
+  uint8_t ssr[64];
+};
+
+static struct sdhc_emul_data emul_data;
+
+static const char *image_path = CONFIG_SDTOOL_EMUL_IMAGE;
+static uint32_t image_size_mb = CONFIG_SDTOOL_EMUL_SIZE_MB;
+
+// ----- Register images
+
+// Sets 'width' bits at spec position 'offset' of a big-endian register of 'nbits'
+static void put_bits(uint8_t *reg, int nbits, int offset, int width, uint32_t v)
+{
+  for (int i = 0; i < width; i++)
+  {
+    int bit = offset + i;
+    uint8_t *p = &reg[(nbits - 1 - bit) / 8];
+    uint8_t mask = 1u << (bit % 8);
+
+    if (v & (1u << i))
+      *p |= mask;
+    else
+      *p &= ~mask;
+  }
+}
+
+static uint32_t div_round_up(uint32_t a, uint32_t b)
+{
+  return (a + b - 1) / b;
+}
+
+static void emul_build_regs(struct sdhc_emul_data *d)
+{
+  memset(d->cid, 0, sizeof(d->cid));
+  d->cid[0] = 0x00;                       // MID
+  memcpy(&d->cid[1], "ZE", 2);            // OID
+  memcpy(&d->cid[3], "EMUSD", 5);         // PNM
+  put_bits(d->cid, 128, 56,  8, 0x10);    // PRV 1.0
+  put_bits(d->cid, 128, 24, 32, 0x5D700001);
+  put_bits(d->cid, 128,  8, 12, (25 << 4) | 1);
+  put_bits(d->cid, 128,  0,  1, 1);
+
+  memset(d->csd, 0, sizeof(d->csd));
+  put_bits(d->csd, 128, 126,  2, 1);      // CSD v2.0
+  put_bits(d->csd, 128, 112,  8, 0x0E);   // TAAC 1 ms
+  put_bits(d->csd, 128,  96,  8, 0x32);   // 25 MHz
+  put_bits(d->csd, 128,  84, 12, 0x5B5);
+  put_bits(d->csd, 128,  80,  4, 9);
+  put_bits(d->csd, 128,  48, 22, d->blocks / 1024 - 1);
+  put_bits(d->csd, 128,  46,  1, 1);
+  put_bits(d->csd, 128,  39,  7, 0x7F);
+  put_bits(d->csd, 128,  26,  3, 2);
+  put_bits(d->csd, 128,  22,  4, 9);
+  put_bits(d->csd, 128,   0,  1, 1);
+
+  memset(d->scr, 0, sizeof(d->scr));
+  put_bits(d->scr, 64, 56, 4, 2);         // SD spec 2.00 ...
+  put_bits(d->scr, 64, 55, 1, IS_ENABLED(CONFIG_SDTOOL_EMUL_ERASE_ONES));
+  put_bits(d->scr, 64, 52, 3, 3);
+  put_bits(d->scr, 64, 48, 4, 0x5);
+  put_bits(d->scr, 64, 47, 1, 1);         // ... + SPEC3
+  put_bits(d->scr, 64, 32, 4, 0x2);       // CMD23
+
+  // Erase timing advertised as an upper bound of the model
+  uint32_t erase_timeout = div_round_up(CONFIG_SDTOOL_EMUL_ERASE_US_PER_AU, 1000000);
+  uint32_t erase_offset  = div_round_up(CONFIG_SDTOOL_EMUL_ERASE_OFFSET_US, 1000000);
+
+  memset(d->ssr, 0, sizeof(d->ssr));
+  put_bits(d->ssr, 512, 440,  8, 4);      // Class 10
+  put_bits(d->ssr, 512, 428,  4, CONFIG_SDTOOL_EMUL_AU_SIZE);
+  put_bits(d->ssr, 512, 408, 16, 1);
+  put_bits(d->ssr, 512, 402,  6, MIN(MAX(erase_timeout, 1), 63));
+  put_bits(d->ssr, 512, 400,  2, MIN(erase_offset, 3));
+  put_bits(d->ssr, 512, 396,  4, 1);      // U1
+  put_bits(d->ssr, 512, 392,  4, CONFIG_SDTOOL_EMUL_AU_SIZE);
+}
+
+static void emul_build_switch(uint32_t arg, uint8_t *buf)
+{
+  static const uint16_t support[6] = { 0x8003, 0x8001, 0x8001, 0x8001, 0x8001, 0x8001 };
+
+  memset(buf, 0, 64);
+  put_bits(buf, 512, 496, 16, 100);
+  put_bits(buf, 512, 368,  8, 1);
+
+  for (int g = 0; g < 6; g++)
+  {
+    uint32_t fn = (arg >> (4 * g)) & 0xF;
+    uint32_t sel = (fn == 0xF) ? 0 : (support[g] & (1u << fn)) ? fn : 0xF;
+
+    put_bits(buf, 512, 400 + 16 * g, 16, support[g]);
+    put_bits(buf, 512, 376 +  4 * g,  4, sel);
+  }
+}
+
+// ----- Timing model
+
+static void emul_set_busy(struct sdhc_emul_data *d, uint64_t us)
+{
+  d->busy_until = k_uptime_ticks() + k_us_to_ticks_ceil64(us);
+}
+
+static bool emul_busy(struct sdhc_emul_data *d)
+{
+  return k_uptime_ticks() < d->busy_until;
+}
+
+static void emul_wait_ready(struct sdhc_emul_data *d)
+{
+  int64_t left = d->busy_until - k_uptime_ticks();
+
+  if (left > 0)
+    k_sleep(K_TICKS(left));
+}
+
+// ----- Commands
+
+static int emul_data_in(struct sdhc_data *data, const uint8_t *src, uint32_t len)
+{
+  if (!data || !data->data)
+    return -EINVAL;
+
+  memcpy(data->data, src, MIN(len, data->block_size));
+  data->bytes_xfered = MIN(len, data->block_size);
+  return 0;
+}
+
+static int emul_rw(struct sdhc_emul_data *d, struct sdhc_command *cmd, struct sdhc_data *data, bool write)
+{
+  if (!data || !data->data || data->block_size != BLK_SIZE)
+  {
+    cmd->response[0] = R1_PARAM_ERR;
+    return -EINVAL;
+  }
+
+  uint32_t lba = cmd->arg;
+
+  if (lba >= d->blocks || data->blocks > d->blocks - lba)
+  {
+    cmd->response[0] = R1_ADDR_ERR;
+    return -EIO;
+  }
+
+  uint8_t *p = d->mem + (uint64_t)lba * BLK_SIZE;
+  uint32_t len = data->blocks * BLK_SIZE;
+
+  if (write)
+  {
+    memcpy(p, data->data, len);
+    d->written = data->blocks;
+    k_busy_wait(data->blocks * CONFIG_SDTOOL_EMUL_XFER_US_PER_BLOCK);
+
+    // Programming runs after the transfer: the card reports busy, like after an erase
+    emul_set_busy(d, (uint64_t)data->blocks * CONFIG_SDTOOL_EMUL_WRITE_BUSY_US);
+  }
+  else
+  {
+    memcpy(data->data, p, len);
+    k_busy_wait(data->blocks * CONFIG_SDTOOL_EMUL_XFER_US_PER_BLOCK);
+  }
+
+  data->bytes_xfered = len;
+  return 0;
+}
+
+static int emul_erase(struct sdhc_emul_data *d)
+{
+  if (d->erase_start > d->erase_end || d->erase_end >= d->blocks)
+    return -EIO;
+
+  uint32_t count = d->erase_end - d->erase_start + 1;
+  uint32_t au_blocks = 32u << (CONFIG_SDTOOL_EMUL_AU_SIZE - 1);  // 16 KB << (n - 1)
+  uint32_t aus = div_round_up(count, au_blocks);
+
+  memset(d->mem + (uint64_t)d->erase_start * BLK_SIZE,
+         IS_ENABLED(CONFIG_SDTOOL_EMUL_ERASE_ONES) ? 0xFF : 0x00,
+         (uint64_t)count * BLK_SIZE);
+
+  emul_set_busy(d, (uint64_t)aus * CONFIG_SDTOOL_EMUL_ERASE_US_PER_AU + CONFIG_SDTOOL_EMUL_ERASE_OFFSET_US);
+  return 0;
+}
+
+static int emul_acmd(struct sdhc_emul_data *d, struct sdhc_command *cmd, struct sdhc_data *data)
+{
+  switch (cmd->opcode)
+  {
+    case SD_APP_SEND_OP_COND:
+      if (d->init_polls > 0)
+        d->init_polls--;
+      else
+        d->idle = false;
+      cmd->response[0] = d->idle ? R1_IDLE : 0;
+      return 0;
+
+    case SD_APP_SEND_STATUS:
+      cmd->response[0] = 0;
+      return emul_data_in(data, d->ssr, sizeof(d->ssr));
+
+    case SD_APP_SEND_SCR:
+      return emul_data_in(data, d->scr, sizeof(d->scr));
+
+    case SD_APP_SEND_NUM_WRITTEN_BLK:
+    {
+      uint8_t n[4] = { d->written >> 24, d->written >> 16, d->written >> 8, d->written };
+      return emul_data_in(data, n, sizeof(n));
+    }
+
+    case 23:  // SET_WR_BLK_ERASE_COUNT
+    case 42:  // SET_CLR_CARD_DETECT
+    case SD_APP_SET_BUS_WIDTH:
+      return 0;
+
+    default:
+      cmd->response[0] = R1_ILLEGAL;
+      return -ENOTSUP;
+  }
+}
+
+static int emul_cmd(struct sdhc_emul_data *d, struct sdhc_command *cmd, struct sdhc_data *data)
+{
+  switch (cmd->opcode)
+  {
+    case SD_GO_IDLE_STATE:
+      d->idle = true;
+      d->init_polls = 1;
+      cmd->response[0] = R1_IDLE;
+      return 0;
+
+    case SD_SEND_IF_COND:
+      cmd->response[1] = cmd->arg & 0xFFF;
+      return 0;
+
+    case SD_SPI_READ_OCR:
+      cmd->response[1] = (d->idle ? 0 : SD_OCR_PWR_BUSY_FLAG) | SD_OCR_HOST_CAP_FLAG | 0x00FF8000;
+      return 0;
+
+    case SD_SPI_CRC_ON_OFF:
+    case SD_SET_BLOCK_SIZE:
+    case SD_STOP_TRANSMISSION:
+      return 0;
+
+    case SD_APP_CMD:
+      d->app_cmd = true;
+      return 0;
+
+    case SD_SEND_CSD:
+      return emul_data_in(data, d->csd, sizeof(d->csd));
+
+    case SD_SEND_CID:
+      return emul_data_in(data, d->cid, sizeof(d->cid));
+
+    case SD_SEND_STATUS:
+      cmd->response[0] = 0;
+      return 0;
+
+    case SD_SWITCH:
+    {
+      uint8_t status[64];
+      emul_build_switch(cmd->arg, status);
+      return emul_data_in(data, status, sizeof(status));
+    }
+
+    case SD_READ_SINGLE_BLOCK:
+    case SD_READ_MULTIPLE_BLOCK:
+      return emul_rw(d, cmd, data, false);
+
+    case SD_WRITE_SINGLE_BLOCK:
+    case SD_WRITE_MULTIPLE_BLOCK:
+      return emul_rw(d, cmd, data, true);
+
+    case SD_ERASE_BLOCK_START:
+      d->erase_start = cmd->arg;
+      return 0;
+
+    case SD_ERASE_BLOCK_END:
+      d->erase_end = cmd->arg;
+      return 0;
+
+    case SD_ERASE_BLOCK_OPERATION:
+      return emul_erase(d);
+
+    default:
+      cmd->response[0] = R1_ILLEGAL;
+      return -ENOTSUP;
+  }
+}
+
+// ----- SDHC driver API
+
+static int sdhc_emul_request(const struct device *dev, struct sdhc_command *cmd, struct sdhc_data *data)
+{
+  struct sdhc_emul_data *d = dev->data;
+
+  if (!d->mem)
+    return -ENODEV;
+
+  // Like the SPI host, wait for DO to go high before sending a command
+  emul_wait_ready(d);
+  k_busy_wait(CONFIG_SDTOOL_EMUL_CMD_LATENCY_US);
+
+  bool app = d->app_cmd;
+  d->app_cmd = false;
+
+  cmd->response[0] = d->idle ? R1_IDLE : 0;
+  cmd->response[1] = 0;
+
+  int rc = app ? emul_acmd(d, cmd, data) : emul_cmd(d, cmd, data);
+  LOG_DBG("%sCMD%u arg 0x%08X rc %d", app ? "A" : "", cmd->opcode, cmd->arg, rc);
+
+  return rc;
+}
+
+static int sdhc_emul_reset(const struct device *dev)
+{
+  struct sdhc_emul_data *d = dev->data;
+
+  d->app_cmd = false;
+  d->idle = true;
+  d->busy_until = 0;
+  return 0;
+}
+
+static int sdhc_emul_set_io(const struct device *dev, struct sdhc_io *ios)
+{
+  return 0;
+}
+
+static int sdhc_emul_get_card_present(const struct device *dev)
+{
+  struct sdhc_emul_data *d = dev->data;
+
+  return d->mem != NULL;
+}
+
+static int sdhc_emul_card_busy(const struct device *dev)
+{
+  return emul_busy(dev->data);
+}
+
+static int sdhc_emul_get_host_props(const struct device *dev, struct sdhc_host_props *props)
+{
+  memset(props, 0, sizeof(*props));
+  props->f_max = 25000000;
+  props->f_min = 400000;
+  props->is_spi = true;
+  props->host_caps.vol_330_support = true;
+  props->max_current_330 = 800;
+  return 0;
+}
+
+static const struct sdhc_driver_api sdhc_emul_api =
+{
+  .reset            = sdhc_emul_reset,
+  .request          = sdhc_emul_request,
+  .set_io           = sdhc_emul_set_io,
+  .get_card_present = sdhc_emul_get_card_present,
+  .card_busy        = sdhc_emul_card_busy,
+  .get_host_props   = sdhc_emul_get_host_props,
+};
+
+static int sdhc_emul_init(const struct device *dev)
+{
+  struct sdhc_emul_data *d = dev->data;
+  uint64_t size = (uint64_t)image_size_mb << 20;
+
+  if (image_size_mb < 1)
+  {
+    LOG_ERR("SD image size must be at least 1 MB");
+    return -EINVAL;
+  }
+
+  int rc = sdcard_file_open(image_path, &size, &d->mem);
+  if (rc)
+    return rc;
+
+  d->blocks = size / BLK_SIZE;
+  emul_build_regs(d);
+  sdhc_emul_reset(dev);
+
+  LOG_INF("Emulated SD card: %s, %u KB", image_path, (uint32_t)(size >> 10));
+  return 0;
+}
+
+DEVICE_DT_INST_DEFINE(0, sdhc_emul_init, NULL, &emul_data, NULL,
+                      POST_KERNEL, CONFIG_SDHC_INIT_PRIORITY, &sdhc_emul_api);
+
+// ----- native_sim command line and exit hooks
+
+static void sdhc_emul_options(void)
+{
+  static struct args_struct_t options[] =
+  {
+    {
+      .option = "sd-image", .name = "path", .type = 's', .dest = (void *)&image_path,
+      .descript = "Host file backing the emulated SD card, default \"" CONFIG_SDTOOL_EMUL_IMAGE "\""
+    },
+    {
+      .option = "sd-size-mb", .name = "size", .type = 'u', .dest = (void *)&image_size_mb,
+      .descript = "Emulated SD card size in MB (multiple of 512 KB)"
+    },
+    ARG_TABLE_ENDMARKER
+  };
+
+  native_add_command_line_opts(options);
+}
+
+static void sdhc_emul_cleanup(void)
+{
+  sdcard_file_close(emul_data.mem, (uint64_t)emul_data.blocks * BLK_SIZE);
+  emul_data.mem = NULL;
+}
+
+NATIVE_TASK(sdhc_emul_options, PRE_BOOT_1, 1);
+NATIVE_TASK(sdhc_emul_cleanup, ON_EXIT, 1);
+
+#endif  // CONFIG_SDTOOL_SDHC_EMUL
@@ -0,0 +1,126 @@
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#ifdef __ZEPHYR__
+#include <zephyr/shell/shell.h>
+#include "sdtool.h"
+#endif
+
+#include "sdregs.h"
+
+// ----- Output sink
+
+#ifdef __ZEPHYR__
+static void shell_sink(reg_text role, const char *s)
+{
+  static const shell_vt100_color color[] = { SHELL_VT100_COLOR_CYAN, SHELL_INFO, SHELL_VT100_COLOR_WHITE };
+  shell_fprintf(sh, color[role], "%s", s);
+}
+
+reg_sink reg_out = shell_sink;
+#else
+static void stdout_sink(reg_text role, const char *s)
+{
+  fputs(s, stdout);
+}
+
+reg_sink reg_out = stdout_sink;
+#endif
+
+static void out(reg_text role, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void out(reg_text role, const char *fmt, ...)
+{
+  char s[128];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(s, sizeof(s), fmt, ap);
+  va_end(ap);
+
+  reg_out(role, s);
+}
+
+// ----- Registers
+
+void print_fields(const reg_field *f, int n, const u32 *raw)
+{
+  char val[96];
+
+  for (int i = 0; i < n; i++)
+  {
+    f[i].fmt(val, sizeof(val), f[i], reg_get(raw, f[i]));
+    out(REG_LABEL, "  %-19s: ", f[i].name);
+    out(REG_VALUE, "%s\n", val);
+  }
+}
+
+void print_csd_info(const u8 *buf, u32 disk_block_count, u32 disk_block_size)
+{
+  u32 raw[4];
+  make_raw_cxd(buf, raw);
+
+  sd_csd csd{};
+  u32 csd_block_count = 0;
+  u16 csd_block_size  = 0;
+
+  sdmmc_decode_csd(&csd, raw, &csd_block_count, &csd_block_size);
+
+  out(REG_TITLE, "CSD decode:\n");
+
+  switch (csd.csd_structure)
+  {
+    case 0:  print_fields(csd1::all, countof(csd1::all), raw); break;
+    case 1:  print_fields(csd2::all, countof(csd2::all), raw); break;
+    case 2:  print_fields(csd3::all, countof(csd3::all), raw); break;
+    default: print_fields(&csd::CSD_STRUCTURE, 1, raw); return;
+  }
+
+  out(REG_LABEL, "  Capacity from CSD  : ");
+  out(REG_VALUE, "%u blocks, %u-byte block\n", csd_block_count, csd_block_size);
+
+  if (!disk_block_size) return;  // offline decode
+
+  out(REG_LABEL, "  Capacity from disk : ");
+  out(REG_VALUE, "%u blocks, %u-byte block\n", disk_block_count, disk_block_size);
+}
+
+void print_cid_info(const u8 *buf)
+{
+  u32 raw[4];
+  make_raw_cxd(buf, raw);
+
+  out(REG_TITLE, "CID decode:\n");
+  print_fields(cid::all, countof(cid::all), raw);
+}
+
+void print_scr_info(const u8 *buf)
+{
+  u32 raw[2];
+  make_raw_words(buf, raw, 2);
+
+  out(REG_TITLE, "SCR decode:\n");
+  print_fields(scr::all, countof(scr::all), raw);
+
+  out(REG_LABEL, "  Physical layer spec: ");
+  out(REG_VALUE, "%s\n", scr_spec_version(raw));
+}
+
+void print_sd_status_info(const u8 *buf)
+{
+  u32 raw[16];
+  make_raw_words(buf, raw, 16);
+
+  out(REG_TITLE, "SD Status (ACMD13) decode:\n");
+  print_fields(ssr::all, countof(ssr::all), raw);
+}
+
+void print_switch_info(const u8 *buf)
+{
+  u32 raw[16];
+  make_raw_words(buf, raw, 16);
+
+  out(REG_TITLE, "CMD6 switch status decode:\n");
+  print_fields(cmd6::all, countof(cmd6::all), raw);
+}
@@ -0,0 +1,440 @@
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sdregs.h"
+
+// ----- Helpers
+
+void make_raw_words(const u8 *buf, u32 *raw, int words)
+{
+  for (int i = 0; i < words; i++)
+  {
+    u32 v = ((u32)buf[i * 4 + 0] << 24) |
+            ((u32)buf[i * 4 + 1] << 16) |
+            ((u32)buf[i * 4 + 2] << 8)  |
+            ((u32)buf[i * 4 + 3] << 0);
+    raw[words - 1 - i] = v;  // word order as used by Zephyr sdmmc.c
+  }
+}
+
+void make_raw_cxd(const u8 *buf, u32 *raw)
+{
+  make_raw_words(buf, raw, 4);
+}
+
+const char *mid_to_name(uint8_t mid)
+{
+  switch (mid)
+  {
+    case 0x00: return "Generic";
+    case 0x01: return "Panasonic";
+    case 0x02: return "Toshiba / Kioxia";
+    case 0x03: return "SanDisk / WD";
+    case 0x05: return "Lenovo";
+    case 0x06: return "SanDisk Extreme Pro / Sabrent";
+    case 0x09: return "ATP";
+    case 0x12: return "Patriot";
+    case 0x1B: return "Samsung";
+    case 0x1D: return "ADATA";
+    case 0x27: return "Phison OEM (Delkin, HP, Integral, Kingston, Lexar, PNY, etc.)";
+    case 0x28: return "Lexar (Longsys)";
+    case 0x31: return "Silicon Power";
+    case 0x41: return "Kingston";
+    case 0x45: return "TEAMGROUP";
+    case 0x56: return "SanDian / various";
+    case 0x6F: return "Hiksemi / HP / Kodak / Lenovo / Netac";
+    case 0x74: return "Transcend / Gigastone";
+    case 0x76: return "PNY / Patriot";
+    case 0x82: return "Sony";
+    case 0x89: return "Netac / Intel";
+    case 0x90: return "Strontium";
+    case 0x92: return "Verbatim";
+    case 0x9B: return "Patriot";
+    case 0x9C: return "Angelbird / Hoodman";
+    case 0xB6: return "Delkin Devices";
+    default:   return "Unknown";
+  }
+}
+
+// TAAC / TRAN_SPEED mantissa, x10
+static const u8 time_mant[16] = { 0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80 };
+
+u32 csd_taac_ns(u8 taac)
+{
+  static const u32 unit_ns[8] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000 };
+  return time_mant[(taac >> 3) & 0xF] * unit_ns[taac & 7] / 10;
+}
+
+u32 csd_tran_speed_kbps(u8 tran_speed)
+{
+  static const u32 unit_kbps[4] = { 100, 1000, 10000, 100000 };
+  if ((tran_speed & 7) > 3) return 0;
+  return time_mant[(tran_speed >> 3) & 0xF] * unit_kbps[tran_speed & 7] / 10;
+}
+
+u32 ssr_au_bytes(u8 au_size)
+{
+  static const u32 au_kb[16] =
+  {
+    0, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 12288, 16384, 24576, 32768, 65536
+  };
+
+  return au_kb[au_size & 0xF] << 10;
+}
+
+const char *scr_spec_version(const u32 raw[2])
+{
+  u8 spec  = reg_get(raw, scr::SD_SPEC);
+  u8 spec3 = reg_get(raw, scr::SD_SPEC3);
+  u8 spec4 = reg_get(raw, scr::SD_SPEC4);
+  u8 specx = reg_get(raw, scr::SD_SPECX);
+
+  if (spec == 0) return "1.0x";
+  if (spec == 1) return "1.10";
+  if (spec != 2) return "unknown";
+  if (!spec3)    return "2.00";
+
+  switch (specx)
+  {
+    case 0:  return spec4 ? "4.xx" : "3.0x";
+    case 1:  return "5.xx";
+    case 2:  return "6.xx";
+    case 3:  return "7.xx";
+    case 4:  return "8.xx";
+    case 5:  return "9.xx";
+    default: return "unknown";
+  }
+}
+
+// ----- Formatters
+
+// Joins names of set bits: names[i] is printed for bit i
+static void fmt_bits(char *out, size_t n, u32 v, const char *const *names, int count)
+{
+  size_t len = snprintf(out, n, "0x%X", (unsigned)v);
+
+  for (int i = 0; i < count && len < n; i++)
+    if ((v & (1u << i)) && names[i])
+      len += snprintf(out + len, n - len, " %s", names[i]);
+}
+
+void fmt_dec(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "%u", (unsigned)v);
+}
+
+void fmt_hex(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "0x%0*X", (f.width + 3) / 4, (unsigned)v);
+}
+
+void fmt_flag(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "%s", v ? "yes" : "no");
+}
+
+void fmt_pow2(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "2^%u = %u bytes", (unsigned)v, 1u << v);
+}
+
+void fmt_ascii(char *out, size_t n, const reg_field &f, u64 v)
+{
+  size_t len = 0;
+
+  for (int sh = f.width - 8; sh >= 0 && len + 1 < n; sh -= 8)
+  {
+    char c = (char)(v >> sh);
+    out[len++] = (c >= 0x20 && c < 0x7F) ? c : '.';
+  }
+
+  out[len] = 0;
+}
+
+void fmt_mid(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "0x%02X (%s)", (unsigned)v, mid_to_name(v));
+}
+
+void fmt_prv(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "%u.%u", (unsigned)(v >> 4) & 0xF, (unsigned)v & 0xF);
+}
+
+void fmt_mdt(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "%04u-%02u", 2000u + ((unsigned)v >> 4), (unsigned)v & 0xF);
+}
+
+void fmt_csd_struct(char *out, size_t n, const reg_field &f, u64 v)
+{
+  static const char *const names[4] =
+  {
+    "CSD v1.0 (SDSC)", "CSD v2.0 (SDHC/SDXC)", "CSD v3.0 (SDUC)", "Reserved/Unknown"
+  };
+  snprintf(out, n, "%u (%s)", (unsigned)v, names[v & 3]);
+}
+
+void fmt_taac(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "0x%02X (%u ns)", (unsigned)v, csd_taac_ns(v));
+}
+
+void fmt_tran_speed(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "0x%02X (%u kbit/s)", (unsigned)v, csd_tran_speed_kbps(v));
+}
+
+void fmt_r2w(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "%u (x%u)", (unsigned)v, 1u << v);
+}
+
+void fmt_erase_state(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "%u (all '%u')", (unsigned)v, (unsigned)v);
+}
+
+void fmt_security(char *out, size_t n, const reg_field &f, u64 v)
+{
+  static const char *const names[8] =
+  {
+    "none", "not used", "SDSC 1.01", "SDHC 2.00", "SDXC 3.xx", "reserved", "reserved", "reserved"
+  };
+  snprintf(out, n, "%u (%s)", (unsigned)v, names[v & 7]);
+}
+
+void fmt_bus_widths(char *out, size_t n, const reg_field &f, u64 v)
+{
+  static const char *const names[] = { "1-bit", NULL, "4-bit" };
+  fmt_bits(out, n, v, names, countof(names));
+}
+
+void fmt_cmd_support(char *out, size_t n, const reg_field &f, u64 v)
+{
+  static const char *const names[] = { "CMD20", "CMD23", "CMD48/49", "CMD58/59" };
+  fmt_bits(out, n, v, names, countof(names));
+}
+
+void fmt_dat_bus_width(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "%u (%s)", (unsigned)v, v == 0 ? "1-bit" : v == 2 ? "4-bit" : "reserved");
+}
+
+void fmt_speed_class(char *out, size_t n, const reg_field &f, u64 v)
+{
+  static const char *const names[] = { "Class 0 (no speed class)", "Class 2", "Class 4", "Class 6", "Class 10" };
+  snprintf(out, n, "0x%02X (%s)", (unsigned)v, v < countof(names) ? names[v] : "Reserved/unknown");
+}
+
+void fmt_perf_move(char *out, size_t n, const reg_field &f, u64 v)
+{
+  if (v == 0xFF)
+    snprintf(out, n, "0xFF (infinite / not limited)");
+  else if (v == 0x00)
+    snprintf(out, n, "0 (not defined)");
+  else
+    snprintf(out, n, "%u MB/s", (unsigned)v);
+}
+
+void fmt_au_size(char *out, size_t n, const reg_field &f, u64 v)
+{
+  u32 au = ssr_au_bytes(v);
+
+  if (!au)
+    snprintf(out, n, "0 (not defined)");
+  else if (au < (1u << 20))
+    snprintf(out, n, "%u (%u KB)", (unsigned)v, au >> 10);
+  else
+    snprintf(out, n, "%u (%u MB)", (unsigned)v, au >> 20);
+}
+
+void fmt_seconds(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "%u s", (unsigned)v);
+}
+
+void fmt_uhs_grade(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, v ? "U%u" : "%u (none)", (unsigned)v);
+}
+
+void fmt_video_class(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, v ? "V%u" : "%u (none)", (unsigned)v);
+}
+
+void fmt_megabytes(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, "%u MB", (unsigned)v);
+}
+
+void fmt_app_class(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, v ? "A%u" : "%u (none)", (unsigned)v);
+}
+
+void fmt_milliamps(char *out, size_t n, const reg_field &f, u64 v)
+{
+  snprintf(out, n, v ? "%u mA" : "%u (error)", (unsigned)v);
+}
+
+void fmt_bus_speeds(char *out, size_t n, const reg_field &f, u64 v)
+{
+  static const char *const names[] = { "SDR12", "HS/SDR25", "SDR50", "SDR104", "DDR50" };
+  fmt_bits(out, n, v, names, countof(names));
+}
+
+void fmt_driver_types(char *out, size_t n, const reg_field &f, u64 v)
+{
+  static const char *const names[] = { "B", "A", "C", "D" };
+  fmt_bits(out, n, v, names, countof(names));
+}
+
+void fmt_current_limits(char *out, size_t n, const reg_field &f, u64 v)
+{
+  static const char *const names[] = { "200mA", "400mA", "600mA", "800mA" };
+  fmt_bits(out, n, v, names, countof(names));
+}
+
+void fmt_timing(char *out, size_t n, const reg_field &f, u64 v)
+{
+  static const char *const names[] = { "Default / SDR12", "High speed / SDR25", "SDR50", "SDR104", "DDR50" };
+  snprintf(out, n, "%u (%s)", (unsigned)v, v < countof(names) ? names[v] : "unknown");
+}
+
+// ----- Decoders (app-private, no linkage to Zephyr internals)
+
+void sdmmc_decode_csd(sd_csd *csd,
+                          const uint32_t raw[4],
+                          uint32_t *blk_count,
+                          uint16_t *blk_size)
+{
+  static const struct { reg_field f; u16 flag; } flag_map[] =
+  {
+    { csd::READ_BL_PARTIAL,    SD_CSD_READ_BLK_PARTIAL_FLAG        },
+    { csd::WRITE_BLK_MISALIGN, SD_CSD_WRITE_BLK_MISALIGN_FLAG      },
+    { csd::READ_BLK_MISALIGN,  SD_CSD_READ_BLK_MISALIGN_FLAG       },
+    { csd::DSR_IMP,            SD_CSD_DSR_IMPLEMENTED_FLAG         },
+    { csd::ERASE_BLK_EN,       SD_CSD_ERASE_BLK_EN_FLAG            },
+    { csd::WP_GRP_ENABLE,      SD_CSD_WRITE_PROTECT_GRP_EN_FLAG    },
+    { csd::WRITE_BL_PARTIAL,   SD_CSD_WRITE_BLK_PARTIAL_FLAG       },
+    { csd::FILE_FORMAT_GRP,    SD_CSD_FILE_FMT_GRP_FLAG            },
+    { csd::COPY,               SD_CSD_COPY_FLAG                    },
+    { csd::PERM_WRITE_PROTECT, SD_CSD_PERMANENT_WRITE_PROTECT_FLAG },
+    { csd::TMP_WRITE_PROTECT,  SD_CSD_TMP_WRITE_PROTECT_FLAG       },
+  };
+
+  memset(csd, 0, sizeof(*csd));
+
+  csd->csd_structure      = reg_get(raw, csd::CSD_STRUCTURE);
+  csd->read_time1         = reg_get(raw, csd::TAAC);
+  csd->read_time2         = reg_get(raw, csd::NSAC);
+  csd->xfer_rate          = reg_get(raw, csd::TRAN_SPEED);
+  csd->cmd_class          = reg_get(raw, csd::CCC);
+  csd->read_blk_len       = reg_get(raw, csd::READ_BL_LEN);
+  csd->erase_size         = reg_get(raw, csd::SECTOR_SIZE);
+  csd->write_prtect_size  = reg_get(raw, csd::WP_GRP_SIZE);
+  csd->write_speed_factor = reg_get(raw, csd::R2W_FACTOR);
+  csd->write_blk_len      = reg_get(raw, csd::WRITE_BL_LEN);
+  csd->file_fmt           = reg_get(raw, csd::FILE_FORMAT);
+
+  for (size_t i = 0; i < countof(flag_map); i++)
+    if (reg_get(raw, flag_map[i].f)) csd->flags |= flag_map[i].flag;
+
+  uint32_t tmp_blk_count = 0;
+  uint16_t tmp_blk_size  = SDMMC_DEFAULT_BLOCK_SIZE;
+
+  if (csd->csd_structure == 0)
+  {
+    // SDSC (v1.x) style capacity
+    csd->device_size       = reg_get(raw, csd1::C_SIZE);
+    csd->read_current_min  = reg_get(raw, csd1::VDD_R_CURR_MIN);
+    csd->read_current_max  = reg_get(raw, csd1::VDD_R_CURR_MAX);
+    csd->write_current_min = reg_get(raw, csd1::VDD_W_CURR_MIN);
+    csd->write_current_max = reg_get(raw, csd1::VDD_W_CURR_MAX);
+    csd->dev_size_mul      = reg_get(raw, csd1::C_SIZE_MULT);
+
+    tmp_blk_count =
+      (csd->device_size + 1u) << (csd->dev_size_mul + 2u);
+    tmp_blk_size = 1u << csd->read_blk_len;
+
+    if (tmp_blk_size != SDMMC_DEFAULT_BLOCK_SIZE)
+    {
+      tmp_blk_count = (tmp_blk_count * tmp_blk_size) /
+                      SDMMC_DEFAULT_BLOCK_SIZE;
+      tmp_blk_size = SDMMC_DEFAULT_BLOCK_SIZE;
+    }
+  }
+  else if (csd->csd_structure == 1)
+  {
+    // SDHC/SDXC (v2.0+) style capacity
+    csd->device_size = reg_get(raw, csd2::C_SIZE);
+    tmp_blk_count    = (csd->device_size + 1u) * 1024u;
+  }
+  else if (csd->csd_structure == 2)
+  {
+    // SDUC (v3.0): capacity overflows 32-bit block count, report the cap
+    csd->device_size = reg_get(raw, csd3::C_SIZE);
+    tmp_blk_count    = 0xFFFFFFFFu;
+  }
+
+  if (blk_count) *blk_count = tmp_blk_count;
+  if (blk_size)  *blk_size  = tmp_blk_size;
+}
+
+void sdmmc_decode_cid(sd_cid *cid, const uint32_t raw[4])
+{
+  memset(cid, 0, sizeof(*cid));
+
+  cid->manufacturer = reg_get(raw, cid::MID);
+  cid->application  = reg_get(raw, cid::OID);
+
+  u64 pnm = reg_get(raw, cid::PNM);
+  for (int i = 0; i < SD_PRODUCT_NAME_BYTES; i++)
+    cid->name[i] = (u8)(pnm >> (8 * (SD_PRODUCT_NAME_BYTES - 1 - i)));
+
+  cid->version = reg_get(raw, cid::PRV);
+  cid->ser_num = reg_get(raw, cid::PSN);
+  cid->date    = reg_get(raw, cid::MDT);  // year/month packed
+}
+
+void sdmmc_decode_scr(sd_scr *scr, const uint32_t raw[2])
+{
+  memset(scr, 0, sizeof(*scr));
+
+  scr->scr_structure = reg_get(raw, scr::SCR_STRUCTURE);
+  scr->sd_spec       = reg_get(raw, scr::SD_SPEC);
+  scr->sd_sec        = reg_get(raw, scr::SD_SECURITY);
+  scr->sd_width      = reg_get(raw, scr::SD_BUS_WIDTHS);
+  scr->sd_ext_sec    = reg_get(raw, scr::EX_SECURITY);
+  scr->cmd_support   = reg_get(raw, scr::CMD_SUPPORT);
+  scr->rsvd          = reg_get(raw, scr::MFR);
+
+  if (reg_get(raw, scr::DATA_STAT_AFTER_ERASE)) scr->flags |= SD_SCR_DATA_STATUS_AFTER_ERASE;
+  if (reg_get(raw, scr::SD_SPEC3))              scr->flags |= SD_SCR_SPEC3;
+}
+
+void sdmmc_decode_ssr(sd_ssr *ssr, const uint32_t raw[16])
+{
+  ssr->dat_bus_width       = reg_get(raw, ssr::DAT_BUS_WIDTH);
+  ssr->secured_mode        = reg_get(raw, ssr::SECURED_MODE);
+  ssr->card_type           = reg_get(raw, ssr::SD_CARD_TYPE);
+  ssr->size_of_prot_area   = reg_get(raw, ssr::SIZE_OF_PROT_AREA);
+  ssr->speed_class         = reg_get(raw, ssr::SPEED_CLASS);
+  ssr->performance_move    = reg_get(raw, ssr::PERFORMANCE_MOVE);
+  ssr->au_size             = reg_get(raw, ssr::AU_SIZE);
+  ssr->erase_size          = reg_get(raw, ssr::ERASE_SIZE);
+  ssr->erase_timeout       = reg_get(raw, ssr::ERASE_TIMEOUT);
+  ssr->erase_offset        = reg_get(raw, ssr::ERASE_OFFSET);
+  ssr->uhs_speed_grade     = reg_get(raw, ssr::UHS_SPEED_GRADE);
+  ssr->uhs_au_size         = reg_get(raw, ssr::UHS_AU_SIZE);
+  ssr->video_speed_class   = reg_get(raw, ssr::VIDEO_SPEED_CLASS);
+  ssr->vsc_au_size         = reg_get(raw, ssr::VSC_AU_SIZE);
+  ssr->sus_addr            = reg_get(raw, ssr::SUS_ADDR);
+  ssr->app_perf_class      = reg_get(raw, ssr::APP_PERF_CLASS);
+  ssr->performance_enhance = reg_get(raw, ssr::PERFORMANCE_ENHANCE);
+  ssr->discard_support     = reg_get(raw, ssr::DISCARD_SUPPORT);
+  ssr->fule_support        = reg_get(raw, ssr::FULE_SUPPORT);
+}
@@ -0,0 +1,324 @@
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __ZEPHYR__
+#include <zephyr/sd/sd_spec.h>
+#else
+#include "sd_spec_host.h"
+#endif
+
+#include "types.h"
+
+// ----- Register field descriptors
+//
+// Every SD register is described by a table of fields. 'offset' is the LSB
+// position of the field as in the spec tables ([msb:lsb]), bit 0 being the LSB
+// of the last byte on the wire. Registers are kept as host-order words with
+// raw[0] holding bits 31:0 (see make_raw_words()).
+
+struct reg_field;
+
+typedef void (*reg_fmt)(char *out, size_t n, const reg_field &f, u64 v);
+
+struct reg_field
+{
+  const char *name;
+  u16 offset;
+  u8  width;
+  reg_fmt fmt;
+};
+
+static inline u64 reg_get(const u32 *raw, const reg_field &f)
+{
+  u32 w = f.offset >> 5;
+  u32 s = f.offset & 31;
+  u64 v = raw[w] >> s;
+
+  if (s + f.width > 32) v |= (u64)raw[w + 1] << (32 - s);
+  if (s + f.width > 64) v |= (u64)raw[w + 2] << (64 - s);
+
+  return (f.width < 64) ? (v & ((1ull << f.width) - 1)) : v;
+}
+
+// ----- Formatters
+
+void fmt_dec(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_hex(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_flag(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_pow2(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_ascii(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_mid(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_prv(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_mdt(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_csd_struct(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_taac(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_tran_speed(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_r2w(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_erase_state(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_security(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_bus_widths(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_cmd_support(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_dat_bus_width(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_speed_class(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_perf_move(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_au_size(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_seconds(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_uhs_grade(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_video_class(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_megabytes(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_app_class(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_milliamps(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_bus_speeds(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_driver_types(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_current_limits(char *out, size_t n, const reg_field &f, u64 v);
+void fmt_timing(char *out, size_t n, const reg_field &f, u64 v);
+
+// ----- CID register (128 bits)
+
+namespace cid
+{
+  constexpr reg_field MID = { "MID (manufacturer)",  120,  8, fmt_mid   };
+  constexpr reg_field OID = { "OID (OEM/app)",       104, 16, fmt_ascii };
+  constexpr reg_field PNM = { "PNM (product)",        64, 40, fmt_ascii };
+  constexpr reg_field PRV = { "PRV (revision)",       56,  8, fmt_prv   };
+  constexpr reg_field PSN = { "PSN (serial)",         24, 32, fmt_hex   };
+  constexpr reg_field MDT = { "MDT (date)",            8, 12, fmt_mdt   };
+  constexpr reg_field CRC = { "CRC7",                  1,  7, fmt_hex   };
+
+  constexpr reg_field all[] = { MID, OID, PNM, PRV, PSN, MDT, CRC };
+}
+
+// ----- CSD register (128 bits), fields common to all structure versions
+
+namespace csd
+{
+  constexpr reg_field CSD_STRUCTURE      = { "CSD structure",      126,  2, fmt_csd_struct };
+  constexpr reg_field TAAC               = { "TAAC (access time)", 112,  8, fmt_taac       };
+  constexpr reg_field NSAC               = { "NSAC (x100 clocks)", 104,  8, fmt_dec        };
+  constexpr reg_field TRAN_SPEED         = { "Max transfer rate",   96,  8, fmt_tran_speed };
+  constexpr reg_field CCC                = { "Command classes",     84, 12, fmt_hex        };
+  constexpr reg_field READ_BL_LEN        = { "Read block length",   80,  4, fmt_pow2       };
+  constexpr reg_field READ_BL_PARTIAL    = { "Partial read",        79,  1, fmt_flag       };
+  constexpr reg_field WRITE_BLK_MISALIGN = { "Write misalign",      78,  1, fmt_flag       };
+  constexpr reg_field READ_BLK_MISALIGN  = { "Read misalign",       77,  1, fmt_flag       };
+  constexpr reg_field DSR_IMP            = { "DSR implemented",     76,  1, fmt_flag       };
+  constexpr reg_field ERASE_BLK_EN       = { "Single-block erase",  46,  1, fmt_flag       };
+  constexpr reg_field SECTOR_SIZE        = { "Erase sector size",   39,  7, fmt_dec        };
+  constexpr reg_field WP_GRP_SIZE        = { "Write protect size",  32,  7, fmt_dec        };
+  constexpr reg_field WP_GRP_ENABLE      = { "WP group enable",     31,  1, fmt_flag       };
+  constexpr reg_field R2W_FACTOR         = { "Write speed factor",  26,  3, fmt_r2w        };
+  constexpr reg_field WRITE_BL_LEN       = { "Write block length",  22,  4, fmt_pow2       };
+  constexpr reg_field WRITE_BL_PARTIAL   = { "Partial write",       21,  1, fmt_flag       };
+  constexpr reg_field FILE_FORMAT_GRP    = { "File format group",   15,  1, fmt_flag       };
+  constexpr reg_field COPY               = { "Copy flag",           14,  1, fmt_flag       };
+  constexpr reg_field PERM_WRITE_PROTECT = { "Perm. write protect", 13,  1, fmt_flag       };
+  constexpr reg_field TMP_WRITE_PROTECT  = { "Temp. write protect", 12,  1, fmt_flag       };
+  constexpr reg_field FILE_FORMAT        = { "File format",         10,  2, fmt_dec        };
+  constexpr reg_field WP_UPC             = { "WP until pwr cycle",   9,  1, fmt_flag       };
+  constexpr reg_field CRC                = { "CRC7",                 1,  7, fmt_hex        };
+}
+
+namespace csd1  // SDSC
+{
+  constexpr reg_field C_SIZE         = { "Device size field",   62, 12, fmt_hex };
+  constexpr reg_field VDD_R_CURR_MIN = { "VDD read curr. min",  59,  3, fmt_dec };
+  constexpr reg_field VDD_R_CURR_MAX = { "VDD read curr. max",  56,  3, fmt_dec };
+  constexpr reg_field VDD_W_CURR_MIN = { "VDD write curr. min", 53,  3, fmt_dec };
+  constexpr reg_field VDD_W_CURR_MAX = { "VDD write curr. max", 50,  3, fmt_dec };
+  constexpr reg_field C_SIZE_MULT    = { "Device size mult.",   47,  3, fmt_dec };
+
+  constexpr reg_field all[] =
+  {
+    csd::CSD_STRUCTURE, csd::TAAC, csd::NSAC, csd::TRAN_SPEED, csd::CCC,
+    csd::READ_BL_LEN, csd::READ_BL_PARTIAL, csd::WRITE_BLK_MISALIGN,
+    csd::READ_BLK_MISALIGN, csd::DSR_IMP,
+    C_SIZE, VDD_R_CURR_MIN, VDD_R_CURR_MAX, VDD_W_CURR_MIN, VDD_W_CURR_MAX, C_SIZE_MULT,
+    csd::ERASE_BLK_EN, csd::SECTOR_SIZE, csd::WP_GRP_SIZE, csd::WP_GRP_ENABLE,
+    csd::R2W_FACTOR, csd::WRITE_BL_LEN, csd::WRITE_BL_PARTIAL, csd::FILE_FORMAT_GRP,
+    csd::COPY, csd::PERM_WRITE_PROTECT, csd::TMP_WRITE_PROTECT, csd::FILE_FORMAT,
+    csd::CRC,
+  };
+}
+
+namespace csd2  // SDHC/SDXC
+{
+  constexpr reg_field C_SIZE = { "Device size field", 48, 22, fmt_hex };
+
+  constexpr reg_field all[] =
+  {
+    csd::CSD_STRUCTURE, csd::TAAC, csd::NSAC, csd::TRAN_SPEED, csd::CCC,
+    csd::READ_BL_LEN, csd::READ_BL_PARTIAL, csd::WRITE_BLK_MISALIGN,
+    csd::READ_BLK_MISALIGN, csd::DSR_IMP,
+    C_SIZE,
+    csd::ERASE_BLK_EN, csd::SECTOR_SIZE, csd::WP_GRP_SIZE, csd::WP_GRP_ENABLE,
+    csd::R2W_FACTOR, csd::WRITE_BL_LEN, csd::WRITE_BL_PARTIAL, csd::FILE_FORMAT_GRP,
+    csd::COPY, csd::PERM_WRITE_PROTECT, csd::TMP_WRITE_PROTECT, csd::FILE_FORMAT,
+    csd::WP_UPC, csd::CRC,
+  };
+}
+
+namespace csd3  // SDUC
+{
+  constexpr reg_field C_SIZE = { "Device size field", 48, 28, fmt_hex };
+
+  constexpr reg_field all[] =
+  {
+    csd::CSD_STRUCTURE, csd::TAAC, csd::NSAC, csd::TRAN_SPEED, csd::CCC,
+    csd::READ_BL_LEN, csd::READ_BL_PARTIAL, csd::WRITE_BLK_MISALIGN,
+    csd::READ_BLK_MISALIGN, csd::DSR_IMP,
+    C_SIZE,
+    csd::ERASE_BLK_EN, csd::SECTOR_SIZE, csd::WP_GRP_SIZE, csd::WP_GRP_ENABLE,
+    csd::R2W_FACTOR, csd::WRITE_BL_LEN, csd::WRITE_BL_PARTIAL, csd::FILE_FORMAT_GRP,
+    csd::COPY, csd::PERM_WRITE_PROTECT, csd::TMP_WRITE_PROTECT, csd::FILE_FORMAT,
+    csd::WP_UPC, csd::CRC,
+  };
+}
+
+// ----- SCR register (64 bits)
+
+namespace scr
+{
+  constexpr reg_field SCR_STRUCTURE         = { "SCR structure",      60,  4, fmt_dec         };
+  constexpr reg_field SD_SPEC               = { "SD spec",            56,  4, fmt_dec         };
+  constexpr reg_field DATA_STAT_AFTER_ERASE = { "Data after erase",   55,  1, fmt_erase_state };
+  constexpr reg_field SD_SECURITY           = { "Security",           52,  3, fmt_security    };
+  constexpr reg_field SD_BUS_WIDTHS         = { "Bus widths support", 48,  4, fmt_bus_widths  };
+  constexpr reg_field SD_SPEC3              = { "SD spec 3",          47,  1, fmt_flag        };
+  constexpr reg_field EX_SECURITY           = { "Extended security",  43,  4, fmt_hex         };
+  constexpr reg_field SD_SPEC4              = { "SD spec 4",          42,  1, fmt_flag        };
+  constexpr reg_field SD_SPECX              = { "SD spec X",          38,  4, fmt_dec         };
+  constexpr reg_field CMD_SUPPORT           = { "CMD support",        32,  4, fmt_cmd_support };
+  constexpr reg_field MFR                   = { "Manufacturer data",   0, 32, fmt_hex         };
+
+  constexpr reg_field all[] =
+  {
+    SCR_STRUCTURE, SD_SPEC, DATA_STAT_AFTER_ERASE, SD_SECURITY, SD_BUS_WIDTHS,
+    SD_SPEC3, EX_SECURITY, SD_SPEC4, SD_SPECX, CMD_SUPPORT, MFR,
+  };
+}
+
+// ----- SD Status register (ACMD13, 512 bits)
+
+namespace ssr
+{
+  constexpr reg_field DAT_BUS_WIDTH       = { "DAT bus width",      510,  2, fmt_dat_bus_width };
+  constexpr reg_field SECURED_MODE        = { "Secured mode",       509,  1, fmt_flag          };
+  constexpr reg_field SD_CARD_TYPE        = { "Card type",          480, 16, fmt_hex           };
+  constexpr reg_field SIZE_OF_PROT_AREA   = { "Protected area",     448, 32, fmt_dec           };
+  constexpr reg_field SPEED_CLASS         = { "Speed class",        440,  8, fmt_speed_class   };
+  constexpr reg_field PERFORMANCE_MOVE    = { "Performance move",   432,  8, fmt_perf_move     };
+  constexpr reg_field AU_SIZE             = { "AU size",            428,  4, fmt_au_size       };
+  constexpr reg_field ERASE_SIZE          = { "Erase size (AUs)",   408, 16, fmt_dec           };
+  constexpr reg_field ERASE_TIMEOUT       = { "Erase timeout",      402,  6, fmt_seconds       };
+  constexpr reg_field ERASE_OFFSET        = { "Erase offset",       400,  2, fmt_seconds       };
+  constexpr reg_field UHS_SPEED_GRADE     = { "UHS speed grade",    396,  4, fmt_uhs_grade     };
+  constexpr reg_field UHS_AU_SIZE         = { "UHS AU size",        392,  4, fmt_au_size       };
+  constexpr reg_field VIDEO_SPEED_CLASS   = { "Video speed class",  384,  8, fmt_video_class   };
+  constexpr reg_field VSC_AU_SIZE         = { "VSC AU size",        368, 10, fmt_megabytes     };
+  constexpr reg_field SUS_ADDR            = { "Suspension address", 346, 22, fmt_hex           };
+  constexpr reg_field APP_PERF_CLASS      = { "App perf. class",    336,  4, fmt_app_class     };
+  constexpr reg_field PERFORMANCE_ENHANCE = { "Perf. enhance",      328,  8, fmt_hex           };
+  constexpr reg_field DISCARD_SUPPORT     = { "Discard support",    313,  1, fmt_flag          };
+  constexpr reg_field FULE_SUPPORT        = { "FULE support",       312,  1, fmt_flag          };
+
+  constexpr reg_field all[] =
+  {
+    DAT_BUS_WIDTH, SECURED_MODE, SD_CARD_TYPE, SIZE_OF_PROT_AREA, SPEED_CLASS,
+    PERFORMANCE_MOVE, AU_SIZE, ERASE_SIZE, ERASE_TIMEOUT, ERASE_OFFSET,
+    UHS_SPEED_GRADE, UHS_AU_SIZE, VIDEO_SPEED_CLASS, VSC_AU_SIZE, SUS_ADDR,
+    APP_PERF_CLASS, PERFORMANCE_ENHANCE, DISCARD_SUPPORT, FULE_SUPPORT,
+  };
+}
+
+// ----- CMD6 switch function status (512 bits)
+
+namespace cmd6
+{
+  constexpr reg_field MAX_CURRENT = { "Max current",        496, 16, fmt_milliamps      };
+  constexpr reg_field FG6_SUPPORT = { "Group 6 support",    480, 16, fmt_hex            };
+  constexpr reg_field FG5_SUPPORT = { "Group 5 support",    464, 16, fmt_hex            };
+  constexpr reg_field FG4_SUPPORT = { "Current limits",     448, 16, fmt_current_limits };
+  constexpr reg_field FG3_SUPPORT = { "Driver types",       432, 16, fmt_driver_types   };
+  constexpr reg_field FG2_SUPPORT = { "Command systems",    416, 16, fmt_hex            };
+  constexpr reg_field FG1_SUPPORT = { "Bus speeds",         400, 16, fmt_bus_speeds     };
+  constexpr reg_field FG6_SEL     = { "Group 6 selected",   396,  4, fmt_hex            };
+  constexpr reg_field FG5_SEL     = { "Group 5 selected",   392,  4, fmt_hex            };
+  constexpr reg_field FG4_SEL     = { "Selected curr.limit", 388,  4, fmt_hex            };
+  constexpr reg_field FG3_SEL     = { "Selected driver",    384,  4, fmt_hex            };
+  constexpr reg_field FG2_SEL     = { "Selected cmd system", 380,  4, fmt_hex            };
+  constexpr reg_field FG1_SEL     = { "Selected timing",    376,  4, fmt_timing         };
+  constexpr reg_field VERSION     = { "Structure version",  368,  8, fmt_dec            };
+  constexpr reg_field FG6_BUSY    = { "Group 6 busy",       352, 16, fmt_hex            };
+  constexpr reg_field FG5_BUSY    = { "Group 5 busy",       336, 16, fmt_hex            };
+  constexpr reg_field FG4_BUSY    = { "Group 4 busy",       320, 16, fmt_hex            };
+  constexpr reg_field FG3_BUSY    = { "Group 3 busy",       304, 16, fmt_hex            };
+  constexpr reg_field FG2_BUSY    = { "Group 2 busy",       288, 16, fmt_hex            };
+  constexpr reg_field FG1_BUSY    = { "Group 1 busy",       272, 16, fmt_hex            };
+
+  constexpr reg_field all[] =
+  {
+    MAX_CURRENT, FG6_SUPPORT, FG5_SUPPORT, FG4_SUPPORT, FG3_SUPPORT, FG2_SUPPORT,
+    FG1_SUPPORT, FG6_SEL, FG5_SEL, FG4_SEL, FG3_SEL, FG2_SEL, FG1_SEL, VERSION,
+    FG6_BUSY, FG5_BUSY, FG4_BUSY, FG3_BUSY, FG2_BUSY, FG1_BUSY,
+  };
+}
+
+// ----- Decoded SD Status (not covered by Zephyr's sd_spec.h)
+
+struct sd_ssr
+{
+  u8  dat_bus_width;
+  u8  secured_mode;
+  u16 card_type;
+  u32 size_of_prot_area;
+  u8  speed_class;
+  u8  performance_move;
+  u8  au_size;
+  u16 erase_size;
+  u8  erase_timeout;
+  u8  erase_offset;
+  u8  uhs_speed_grade;
+  u8  uhs_au_size;
+  u8  video_speed_class;
+  u16 vsc_au_size;
+  u32 sus_addr;
+  u8  app_perf_class;
+  u8  performance_enhance;
+  u8  discard_support;
+  u8  fule_support;
+};
+
+// ----- Decoders
+
+void make_raw_words(const u8 *buf, u32 *raw, int words);  // big-endian → raw[0] = bits 31:0
+void make_raw_cxd(const u8 *buf, u32 *raw);               // CSD/CID helper
+
+void sdmmc_decode_csd(sd_csd *csd, const uint32_t raw[4], uint32_t *blk_count, uint16_t *blk_size);
+void sdmmc_decode_cid(sd_cid *cid, const uint32_t raw[4]);
+void sdmmc_decode_scr(sd_scr *scr, const uint32_t raw[2]);
+void sdmmc_decode_ssr(sd_ssr *ssr, const uint32_t raw[16]);
+
+const char *mid_to_name(uint8_t mid);
+const char *scr_spec_version(const u32 raw[2]);
+u32 csd_taac_ns(u8 taac);
+u32 csd_tran_speed_kbps(u8 tran_speed);
+u32 ssr_au_bytes(u8 au_size);
+
+// ----- Printers (sdprint.cpp): the 'info' and 'decode' output
+//
+// Text goes to 'reg_out' piece by piece, tagged with its role: the shell on the firmware,
+// stdout on the host unless a tool redirects it (tests capture it this way).
+
+enum reg_text { REG_TITLE, REG_LABEL, REG_VALUE };
+
+typedef void (*reg_sink)(reg_text role, const char *s);
+extern reg_sink reg_out;
+
+void print_fields(const reg_field *f, int n, const u32 *raw);
+void print_csd_info(const u8 *buf, u32 disk_block_count, u32 disk_block_size);  // 0, 0: offline
+void print_cid_info(const u8 *buf);
+void print_scr_info(const u8 *buf);
+void print_sd_status_info(const u8 *buf);
+void print_switch_info(const u8 *buf);
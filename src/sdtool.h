@@ -0,0 +1,79 @@
+
+#pragma once
+
+#include <zephyr/shell/shell.h>
+#include <zephyr/sd/sd.h>
+
+#include "types.h"
+
+// ----- Shared between shell command modules (implemented in shell.cpp)
+
+extern const shell *sh;
+
+void dump(u8 *buf, int n, char c = 0);
+int disk_info(uint64_t &size_mb, uint32_t &block_count, uint32_t &block_size);
+
+sd_card *sd_get_card();
+u32 sd_blk_addr(u32 lba);  // data address for CMD17/18/24/25/32/33 (bytes on SDSC)
+
+int sd_cmd(uint32_t opcode, uint32_t arg, uint32_t response_type, uint8_t *buf = NULL, uint32_t size = 1);
+int sd_acmd(uint32_t opcode, uint32_t arg, uint32_t response_type, uint8_t *buf = NULL, uint32_t size = 1);
+
+int sd_read_block(u32 lba, u8 *buf);
+int sd_write_block(u32 lba, const u8 *buf);
+int sd_erase(u32 first, u32 last);
+
+// Multi-block transfers (CMD18/CMD25 for count > 1) straight from/to 'buf'
+int sd_read_blocks(u32 lba, u32 count, u8 *buf);
+int sd_write_blocks(u32 lba, u32 count, const u8 *buf);
+
+// Erase/allocation geometry from CSD, SSR and SCR (card must be initialized)
+struct sd_geom
+{
+  u32 erase_blocks;   // CSD erase sector, in 512-byte blocks
+  u32 au_blocks;      // SSR allocation unit, 0 if not defined
+  u16 erase_size;     // SSR: AUs per ERASE_TIMEOUT
+  u8  erase_timeout;  // s
+  u8  erase_offset;   // s
+  u8  erase_ones;     // SCR DATA_STAT_AFTER_ERASE
+  u32 read_ms;        // data timeouts from CSD
+  u32 write_ms;
+};
+
+int sd_geometry(sd_geom &g);
+const sd_geom &sd_get_geom();  // as read by the last disk_info()
+int erase_verify(u32 block_count, bool full);  // -EIO if any block is not erased
+u32 sd_erase_timeout_ms(u32 blocks);
+
+// I/O buffer pool (pool.cpp): SD_BUF_BLOCKS blocks each, aligned for the SDHC host
+#define SD_BUF_BLOCKS CONFIG_SDTOOL_POOL_BLOCKS
+
+u8 *sd_buf_get();  // NULL if all buffers are in use
+void sd_buf_put(u8 *buf);
+
+// Scoped pool buffer, returned on scope exit
+struct sd_buf
+{
+  u8 *p;
+
+  sd_buf() : p(sd_buf_get()) {}
+  ~sd_buf() { if (p) sd_buf_put(p); }
+
+  sd_buf(const sd_buf &) = delete;
+  sd_buf &operator=(const sd_buf &) = delete;
+};
+
+// Data pattern of 'bench write', word 'j' of block 'lba'
+static inline u32 bench_pattern(u32 lba, u32 j)
+{
+  return lba ^ (j * 0x9E3779B9u);
+}
+
+// Command trace (trace.cpp)
+#define TRACE_ACMD 0x40  // opcode flag: application command
+
+#ifdef CONFIG_SDTOOL_TRACE
+void trace_record(u8 op, u32 arg, u32 t0, u32 busy, u16 blocks, int rc);
+#else
+static inline void trace_record(u8 op, u32 arg, u32 t0, u32 busy, u16 blocks, int rc) {}
+#endif
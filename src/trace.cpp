@@ -0,0 +1,194 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+
+#include "types.h"
+#include "sdtool.h"
+
+#ifdef CONFIG_SDTOOL_TRACE
+
+// ----- Lock-free command trace ring
+//
+// Writers claim a slot with one atomic increment and publish it by storing the
+// sequence number last; a reader copies a record and keeps it only if the sequence
+// still matches, so records overwritten while being read are dropped, not torn.
+
+#define TRACE_DEPTH CONFIG_SDTOOL_TRACE_DEPTH
+
+BUILD_ASSERT((TRACE_DEPTH & (TRACE_DEPTH - 1)) == 0, "SDTOOL_TRACE_DEPTH must be a power of 2");
+
+struct trace_rec
+{
+  u32 seq;     // index + 1, 0 while being written
+  u32 t0;      // start, cycles
+  u32 arg;
+  u32 dur;     // cycles, including busy
+  u32 busy;    // cycles waiting for R1b busy release
+  u16 blocks;
+  u8  op;      // opcode | TRACE_ACMD
+  s8  rc;
+};
+
+static trace_rec trace_buf[TRACE_DEPTH];
+static atomic_t trace_head;
+
+void trace_record(u8 op, u32 arg, u32 t0, u32 busy, u16 blocks, int rc)
+{
+  u32 idx = (u32)atomic_inc(&trace_head);
+  trace_rec &r = trace_buf[idx & (TRACE_DEPTH - 1)];
+
+  r.seq = 0;
+  barrier_dmem_fence_full();
+
+  r.t0     = t0;
+  r.arg    = arg;
+  r.dur    = k_cycle_get_32() - t0;
+  r.busy   = busy;
+  r.blocks = blocks;
+  r.op     = op;
+  r.rc     = _max(rc, -128);
+
+  barrier_dmem_fence_full();
+  r.seq = idx + 1;
+}
+
+// Copies record 'idx', false if it was overwritten or is still being written
+static bool trace_get(u32 idx, trace_rec &r)
+{
+  r = trace_buf[idx & (TRACE_DEPTH - 1)];
+  barrier_dmem_fence_full();
+
+  return r.seq == idx + 1 && trace_buf[idx & (TRACE_DEPTH - 1)].seq == idx + 1;
+}
+
+// Oldest index still in the ring
+static u32 trace_tail(u32 head)
+{
+  return (head > TRACE_DEPTH) ? head - TRACE_DEPTH : 0;
+}
+
+static const char *trace_op(u8 op, char *s, size_t n)
+{
+  snprintf(s, n, "%s%u", (op & TRACE_ACMD) ? "ACMD" : "CMD", op & ~TRACE_ACMD);
+  return s;
+}
+
+// ----- Shell commands
+
+int cmd_trace_dump(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+  u32 head = atomic_get(&trace_head);
+  u32 tail = trace_tail(head);
+  u32 n = (argc > 1) ? strtoul(argv[1], NULL, 0) : 32;
+
+  if (head - tail > n)
+    tail = head - n;
+
+  shell_fprintf(sh, SHELL_INFO, "%8s %10s %-6s %-10s %4s %9s %9s %4s\n",
+                "#", "+t, us", "op", "arg", "blk", "dur, us", "busy, us", "rc");
+
+  trace_rec r, prev;
+  bool have_prev = false;
+
+  for (u32 i = tail; i < head; i++)
+  {
+    if (!trace_get(i, r))
+      continue;
+
+    char op[8];
+    u32 dt = have_prev ? k_cyc_to_us_floor32(r.t0 - prev.t0) : 0;
+
+    shell_fprintf(sh, r.rc ? SHELL_WARNING : SHELL_VT100_COLOR_WHITE,
+                  "%8u %10u %-6s 0x%08X %4u %9u %9u %4d\n",
+                  i, dt, trace_op(r.op, op, sizeof(op)), r.arg, r.blocks,
+                  k_cyc_to_us_floor32(r.dur), k_cyc_to_us_floor32(r.busy), r.rc);
+
+    prev = r;
+    have_prev = true;
+  }
+
+  return 0;
+}
+
+int cmd_trace_stats(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+  u32 head = atomic_get(&trace_head);
+  u32 tail = trace_tail(head);
+  u32 seen[256 / 32] = { 0 };
+  trace_rec r;
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Records");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u in ring, %u total, depth %u\n", head - tail, head, TRACE_DEPTH);
+
+  for (u32 i = tail; i < head; i++)
+    if (trace_get(i, r))
+      seen[r.op / 32] |= 1u << (r.op % 32);
+
+  shell_fprintf(sh, SHELL_INFO, "%-6s %6s %6s %9s %9s %9s %9s %9s\n",
+                "op", "count", "errors", "min, us", "avg, us", "max, us", "busy, us", "blocks");
+
+  // One pass over the ring per opcode present: no per-opcode tables in RAM
+  for (u32 op = 0; op < 256; op++)
+  {
+    if (!(seen[op / 32] & (1u << (op % 32))))
+      continue;
+
+    u32 count = 0, errors = 0, blocks = 0;
+    u32 min = UINT32_MAX, max = 0;
+    u64 sum = 0, busy = 0;
+
+    for (u32 i = tail; i < head; i++)
+    {
+      if (!trace_get(i, r) || r.op != op)
+        continue;
+
+      count++;
+      errors += r.rc != 0;
+      blocks += r.blocks;
+      sum    += r.dur;
+      busy   += r.busy;
+      min = _min(min, r.dur);
+      max = _max(max, r.dur);
+    }
+
+    if (!count)
+      continue;
+
+    char name[8];
+    shell_fprintf(sh, errors ? SHELL_WARNING : SHELL_VT100_COLOR_WHITE,
+                  "%-6s %6u %6u %9u %9u %9u %9u %9u\n",
+                  trace_op(op, name, sizeof(name)), count, errors,
+                  k_cyc_to_us_floor32(min), k_cyc_to_us_floor32((u32)(sum / count)), k_cyc_to_us_floor32(max),
+                  k_cyc_to_us_floor32((u32)(busy / count)), blocks);
+  }
+
+  return 0;
+}
+
+int cmd_trace_clear(const shell *sh_, size_t argc, char **argv)
+{
+  sh = sh_;
+
+  atomic_set(&trace_head, 0);
+  memset(trace_buf, 0, sizeof(trace_buf));
+
+  return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_trace,
+  SHELL_CMD_ARG(dump,  NULL, "Print last records: [count]", cmd_trace_dump, 1, 1),
+  SHELL_CMD_ARG(stats, NULL, "Per-opcode latency summary", cmd_trace_stats, 1, 0),
+  SHELL_CMD_ARG(clear, NULL, "Empty the trace ring", cmd_trace_clear, 1, 0),
+  SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(trace, &sub_trace, "SD command trace", NULL);
+
+#endif  // CONFIG_SDTOOL_TRACE
@@ -0,0 +1,152 @@
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sd/sd_spec.h>
+
+#include "types.h"
+#include "sdtool.h"
+
+// ----- Post-erase verification
+//
+// Sparse pass: if a share P of the blocks kept old data, n = ln(1 - C) / ln(1 - P)
+// independent random blocks find at least one of them with confidence C. The card
+// is split into n equal strata and one block is read at a random spot in each: that
+// misses with at most (1 - P)^n too, however the unerased blocks cluster, and it
+// covers every region of the card. The unit must be one block - reading chunks
+// would only give as many independent draws as there are chunks.
+
+#define BLK SDMMC_DEFAULT_BLOCK_SIZE
+
+// C = 99.9 %, P = 0.1 %: ln(0.001) / ln(0.999) = 6904.3
+#define VERIFY_SAMPLE_BLOCKS 6905
+
+struct verify_stat
+{
+  u32 blocks;
+  u32 bad;
+  u32 first_bad;
+};
+
+static u32 verify_rand;
+
+static u32 xorshift32()
+{
+  u32 x = verify_rand;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return verify_rand = x;
+}
+
+// Whole-word compare: OR (or AND) a block together, one test per block
+static bool block_is(const u32 *w, bool ones)
+{
+  u32 acc = ones ? 0xFFFFFFFF : 0;
+
+  if (ones)
+    for (u32 i = 0; i < BLK / 4; i++) acc &= w[i];
+  else
+    for (u32 i = 0; i < BLK / 4; i++) acc |= w[i];
+
+  return acc == (ones ? 0xFFFFFFFF : 0);
+}
+
+static int verify_chunk(u8 *buf, u32 lba, u32 n, bool ones, verify_stat &st)
+{
+  int rc = sd_read_blocks(lba, n, buf);
+  if (rc)
+  {
+    shell_print(sh, "Read %u+%u, rc %d", lba, n, rc);
+    return rc;
+  }
+
+  for (u32 i = 0; i < n; i++)
+  {
+    if (!block_is((const u32 *)(buf + i * BLK), ones))
+    {
+      if (!st.bad++)
+        st.first_bad = lba + i;
+    }
+  }
+
+  st.blocks += n;
+  return 0;
+}
+
+static void verify_report(const char *what, const verify_stat &st, s64 ms)
+{
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", what);
+  ms = _max(ms, 1);
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u blocks in %u ms, %u KB/s, ",
+                st.blocks, (u32)ms, (u32)((u64)st.blocks * BLK * 1000 / 1024 / ms));
+
+  if (st.bad)
+    shell_fprintf(sh, SHELL_ERROR, "%u not erased, first at %u\n", st.bad, st.first_bad);
+  else
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "all erased\n");
+}
+
+int erase_verify(u32 block_count, bool full)
+{
+  bool ones = sd_get_geom().erase_ones;
+  int rc;
+
+  sd_buf b;
+  if (!b.p) return -ENOMEM;
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Expected fill");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "0x%02X (SCR DATA_STAT_AFTER_ERASE)\n", ones ? 0xFF : 0x00);
+
+  // ----- Sparse pass
+
+  u32 strata = _min((u32)VERIFY_SAMPLE_BLOCKS, block_count);
+
+  shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "Sample");
+  shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "%u blocks, one in each 1/%u of the card\n", strata, strata);
+  if (strata == VERIFY_SAMPLE_BLOCKS)
+  {
+    shell_fprintf(sh, SHELL_INFO,              "  %-19s: ", "");
+    shell_fprintf(sh, SHELL_VT100_COLOR_WHITE, "99.9 %% to catch 0.1 %% of blocks unerased\n");
+  }
+
+  verify_stat st = { 0, 0, 0 };
+  verify_rand = k_cycle_get_32() | 1;
+  s64 t = k_uptime_get();
+
+  for (u32 s = 0; s < strata; s++)
+  {
+    u32 lo = (u64)block_count * s / strata;
+    u32 hi = (u64)block_count * (s + 1) / strata;
+
+    rc = verify_chunk(b.p, lo + xorshift32() % (hi - lo), 1, ones, st);
+    if (rc) return rc;
+  }
+
+  verify_report("Sparse pass", st, k_uptime_get() - t);
+
+  if (st.bad || !full)
+    return st.bad ? -EIO : 0;
+
+  // ----- Full pass
+
+  st = { 0, 0, 0 };
+  t = k_uptime_get();
+  u32 step = _max(block_count / 10, 1u);
+  u32 next = step;
+
+  for (u32 lba = 0; lba < block_count; lba += SD_BUF_BLOCKS)
+  {
+    rc = verify_chunk(b.p, lba, _min((u32)SD_BUF_BLOCKS, block_count - lba), ones, st);
+    if (rc) return rc;
+
+    if (st.blocks >= next)
+    {
+      shell_print(sh, "  %u %%", (u32)((u64)st.blocks * 100 / block_count));
+      next += step;
+    }
+  }
+
+  verify_report("Full pass", st, k_uptime_get() - t);
+
+  return st.bad ? -EIO : 0;
+}
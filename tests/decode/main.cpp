@@ -0,0 +1,407 @@
+
+// decode_test - golden-dump regression and micro-benchmark for the register decoders.
+//
+// Reads golden files of register dumps ('cid|csd|scr|ssr|cmd6 <hex>', as printed by
+// 'info -r') each followed by its expected decode, runs every dump through the firmware
+// decoders (src/sdregs.cpp) and the printers 'info' and 'decode' use (src/sdprint.cpp),
+// and compares the text. Then times make_raw_*() + sdmmc_decode_*() and the full print
+// per dump.
+//
+//   decode_test [-u] [-n iterations] golden.txt...
+//
+// -u rewrites the expected decodes from the current code (review the diff!). A file of
+// bare dumps, e.g. a fleet inventory log cut down to the dump lines, becomes a golden
+// file this way.
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <strings.h>
+
+#include "types.h"
+#include "sdregs.h"
+
+// ----- Golden file
+
+enum reg_kind { REG_CID, REG_CSD, REG_SCR, REG_SSR, REG_CMD6, REG_KINDS };
+
+static const struct { const char *name; int len; } reg_names[REG_KINDS] =
+{
+  { "cid",  16 },
+  { "csd",  16 },
+  { "scr",   8 },
+  { "ssr",  64 },
+  { "cmd6", 64 },
+};
+
+struct golden
+{
+  int line;                        // of the dump in the golden file
+  std::vector<std::string> head;   // comments and the dump line itself
+  reg_kind kind;
+  u8 buf[64];
+  std::vector<std::string> expect;
+};
+
+static int hex_val(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// "<reg> <hex>", hex may be split by spaces
+static bool parse_dump(const std::string &s, reg_kind &kind, u8 *buf)
+{
+  for (int k = 0; k < REG_KINDS; k++)
+  {
+    size_t nl = strlen(reg_names[k].name);
+    if (strncasecmp(s.c_str(), reg_names[k].name, nl) || s[nl] != ' ') continue;
+
+    int n = 0;
+    for (size_t i = nl; i < s.size(); i++)
+    {
+      if (s[i] == ' ') continue;
+      int v = hex_val(s[i]);
+      if (v < 0 || n >= 2 * reg_names[k].len) return false;
+      buf[n / 2] = (n & 1) ? (buf[n / 2] | v) : (v << 4);
+      n++;
+    }
+
+    kind = (reg_kind)k;
+    return n == 2 * reg_names[k].len;
+  }
+
+  return false;
+}
+
+static bool load(const char *path, std::vector<golden> &g, std::vector<std::string> &tail)
+{
+  std::ifstream in(path);
+  if (!in)
+  {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return false;
+  }
+
+  std::vector<std::string> pending;
+  std::string s;
+  int line = 0;
+
+  while (std::getline(in, s))
+  {
+    line++;
+    if (!s.empty() && s.back() == '\r') s.pop_back();
+
+    if (s.compare(0, 2, "  ") == 0)
+    {
+      if (g.empty() || !pending.empty())
+      {
+        fprintf(stderr, "%s:%d: decode line without a dump\n", path, line);
+        return false;
+      }
+      g.back().expect.push_back(s);
+      continue;
+    }
+
+    pending.push_back(s);
+    if (s.empty() || s[0] == '#') continue;
+
+    golden r;
+    if (!parse_dump(s, r.kind, r.buf))
+    {
+      fprintf(stderr, "%s:%d: bad dump '%s'\n", path, line, s.c_str());
+      return false;
+    }
+
+    r.line = line;
+    r.head.swap(pending);
+    g.push_back(r);
+  }
+
+  tail.swap(pending);
+  return true;
+}
+
+// ----- Decode to text through the firmware's printers (src/sdprint.cpp)
+
+static std::string printed;
+
+static void capture_sink(reg_text role, const char *s)
+{
+  printed += s;
+}
+
+static void null_sink(reg_text role, const char *s)
+{
+}
+
+static void print_reg(reg_kind kind, const u8 *buf)
+{
+  switch (kind)
+  {
+    case REG_CID:  print_cid_info(buf); break;
+    case REG_CSD:  print_csd_info(buf, 0, 0); break;  // as 'decode csd'
+    case REG_SCR:  print_scr_info(buf); break;
+    case REG_SSR:  print_sd_status_info(buf); break;
+    case REG_CMD6:
+    default:       print_switch_info(buf); break;
+  }
+}
+
+// Decoder structs, which 'info' does not print
+static void add_line(std::vector<std::string> &out, const char *name, const char *fmt, ...)
+  __attribute__((format(printf, 3, 4)));
+
+static void add_line(std::vector<std::string> &out, const char *name, const char *fmt, ...)
+{
+  char val[160], line[192];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(val, sizeof(val), fmt, ap);
+  va_end(ap);
+
+  snprintf(line, sizeof(line), "  %-19s: %s", name, val);
+  out.push_back(line);
+}
+
+static void add_structs(reg_kind kind, const u8 *buf, std::vector<std::string> &out)
+{
+  u32 raw[16];
+
+  switch (kind)
+  {
+    case REG_CID:
+    {
+      sd_cid cid{};
+      make_raw_cxd(buf, raw);
+      sdmmc_decode_cid(&cid, raw);
+      add_line(out, "sd_cid", "mid 0x%02X, oid 0x%04X, pnm '%.5s', rev 0x%02X, psn 0x%08X, mdt 0x%03X",
+               cid.manufacturer, cid.application, (const char *)cid.name, cid.version, cid.ser_num, cid.date);
+      break;
+    }
+
+    case REG_CSD:
+    {
+      sd_csd csd{};
+      u32 blk_count = 0;
+      u16 blk_size = 0;
+      make_raw_cxd(buf, raw);
+      sdmmc_decode_csd(&csd, raw, &blk_count, &blk_size);
+      if (csd.csd_structure > 2) break;
+      add_line(out, "sd_csd", "struct %u, ccc 0x%03X, flags 0x%03X, c_size %u, erase_size %u",
+               csd.csd_structure, csd.cmd_class, csd.flags, csd.device_size, csd.erase_size);
+      break;
+    }
+
+    case REG_SCR:
+    {
+      sd_scr scr{};
+      make_raw_words(buf, raw, 2);
+      sdmmc_decode_scr(&scr, raw);
+      add_line(out, "sd_scr", "flags 0x%02X, spec %u, sec %u, width 0x%X, cmd 0x%X",
+               scr.flags, scr.sd_spec, scr.sd_sec, scr.sd_width, scr.cmd_support);
+      break;
+    }
+
+    case REG_SSR:
+    {
+      sd_ssr ssr{};
+      make_raw_words(buf, raw, 16);
+      sdmmc_decode_ssr(&ssr, raw);
+      add_line(out, "sd_ssr", "au %u (%u bytes), erase %u/%u/%u",
+               ssr.au_size, ssr_au_bytes(ssr.au_size), ssr.erase_size, ssr.erase_timeout, ssr.erase_offset);
+      break;
+    }
+
+    case REG_CMD6:
+    default:
+      break;
+  }
+}
+
+// Printer output, one line per expected line (indented, so the golden file can tell
+// them from dumps), then the decoder structs
+static void decode_text(reg_kind kind, const u8 *buf, std::vector<std::string> &out)
+{
+  out.clear();
+  printed.clear();
+
+  reg_out = capture_sink;
+  print_reg(kind, buf);
+
+  for (size_t p = 0, q; (q = printed.find('\n', p)) != std::string::npos; p = q + 1)
+    out.push_back("  " + printed.substr(p, q - p));
+
+  add_structs(kind, buf, out);
+}
+
+// Decoder only, no text: what a bulk inventory run pays per dump
+static u32 decode_only(reg_kind kind, const u8 *buf)
+{
+  u32 raw[16];
+
+  switch (kind)
+  {
+    case REG_CID: { sd_cid cid; make_raw_cxd(buf, raw); sdmmc_decode_cid(&cid, raw); return cid.ser_num; }
+    case REG_CSD: { sd_csd csd; u32 c = 0; u16 s = 0; make_raw_cxd(buf, raw); sdmmc_decode_csd(&csd, raw, &c, &s); return c; }
+    case REG_SCR: { sd_scr scr; make_raw_words(buf, raw, 2); sdmmc_decode_scr(&scr, raw); return scr.flags; }
+    case REG_SSR: { sd_ssr ssr; make_raw_words(buf, raw, 16); sdmmc_decode_ssr(&ssr, raw); return ssr.au_size; }
+    default:
+    {
+      u32 sum = 0;
+      make_raw_words(buf, raw, 16);
+      for (size_t i = 0; i < countof(cmd6::all); i++)
+        sum += reg_get(raw, cmd6::all[i]);
+      return sum;
+    }
+  }
+}
+
+// ----- Benchmark
+
+static volatile u32 bench_sink;
+
+static void bench(const std::vector<golden> &g, u32 iters)
+{
+  typedef std::chrono::steady_clock clk;
+
+  printf("%-5s %6s %12s %12s\n", "reg", "dumps", "decode, ns", "print, ns");
+
+  for (int k = 0; k < REG_KINDS; k++)
+  {
+    std::vector<const golden *> set;
+    for (const auto &r : g)
+      if (r.kind == k) set.push_back(&r);
+    if (set.empty()) continue;
+
+    u64 n = (u64)iters * set.size();
+    u32 sink = 0;
+
+    auto t0 = clk::now();
+    for (u32 i = 0; i < iters; i++)
+      for (const golden *r : set)
+        sink += decode_only(r->kind, r->buf);
+    auto t1 = clk::now();
+
+    reg_out = null_sink;
+    u32 print_iters = _max(iters / 16, 1u);
+    for (u32 i = 0; i < print_iters; i++)
+      for (const golden *r : set)
+        print_reg(r->kind, r->buf);
+    auto t2 = clk::now();
+
+    bench_sink = sink;
+
+    double dec = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+    double prn = std::chrono::duration<double, std::nano>(t2 - t1).count() / ((u64)print_iters * set.size());
+    printf("%-5s %6zu %12.1f %12.1f\n", reg_names[k].name, set.size(), dec, prn);
+  }
+}
+
+// ----- Main
+
+// Compares (or with 'update' rewrites) the expected decodes of one golden file
+static int check_file(const char *path, bool update, std::vector<golden> &all)
+{
+  std::vector<golden> g;
+  std::vector<std::string> tail;
+  if (!load(path, g, tail))
+    return -1;
+
+  std::vector<std::string> got;
+  int failed = 0;
+
+  for (auto &r : g)
+  {
+    decode_text(r.kind, r.buf, got);
+
+    if (update)
+    {
+      r.expect = got;
+      continue;
+    }
+
+    if (got == r.expect)
+      continue;
+
+    failed++;
+    fprintf(stderr, "%s:%d: %s decode differs\n", path, r.line, reg_names[r.kind].name);
+
+    for (size_t i = 0; i < _max(got.size(), r.expect.size()); i++)
+    {
+      const char *e = (i < r.expect.size()) ? r.expect[i].c_str() : "";
+      const char *o = (i < got.size()) ? got[i].c_str() : "";
+      if (strcmp(e, o))
+        fprintf(stderr, "  - %s\n  + %s\n", e, o);
+    }
+  }
+
+  if (update)
+  {
+    std::ofstream out(path);
+    for (const auto &r : g)
+    {
+      for (const auto &s : r.head)   out << s << "\n";
+      for (const auto &s : r.expect) out << s << "\n";
+    }
+    for (const auto &s : tail) out << s << "\n";
+
+    printf("%s: %zu decodes updated\n", path, g.size());
+  }
+  else
+    printf("%s: %zu dumps, %d failed\n", path, g.size(), failed);
+
+  all.insert(all.end(), g.begin(), g.end());
+  return failed;
+}
+
+int main(int argc, char **argv)
+{
+  bool update = false;
+  u32 iters = 100000;
+  std::vector<const char *> paths;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-u"))
+      update = true;
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+      iters = strtoul(argv[++i], NULL, 0);
+    else
+      paths.push_back(argv[i]);
+  }
+
+  if (paths.empty())
+  {
+    fprintf(stderr, "usage: decode_test [-u] [-n iterations] golden.txt...\n");
+    return 2;
+  }
+
+  std::vector<golden> all;
+  int failed = 0;
+
+  for (const char *path : paths)
+  {
+    int rc = check_file(path, update, all);
+    if (rc < 0)
+      return 2;
+    failed += rc;
+  }
+
+  if (update)
+    return 0;
+
+  if (iters)
+    bench(all, iters);
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+# Shell fixture for the native_sim build with the emulated SD card (see sample.yaml)
+
+import logging
+
+import pytest
+from twister_harness import DeviceAdapter, Shell
+
+logger = logging.getLogger(__name__)
+
+PROMPT = 'SD test>'
+
+
+class SdShell:
+    def __init__(self, shell: Shell):
+        self.shell = shell
+
+    def run(self, cmd: str, timeout: float = 60.0) -> str:
+        lines = self.shell.exec_command(cmd, timeout=timeout)
+        return '\n'.join(lines)
+
+
+@pytest.fixture(scope='session')
+def sd(dut: DeviceAdapter) -> SdShell:
+    shell = Shell(dut, prompt=PROMPT, timeout=20.0)
+
+    logger.info('Wait for prompt')
+    if not shell.wait_for_prompt():
+        pytest.fail('Prompt not found')
+
+    return SdShell(shell)
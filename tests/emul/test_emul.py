@@ -0,0 +1,103 @@
+# End-to-end checks of the shell commands against the file-backed emulated card.
+# Tests share one simulator run and card image, so they run in file order.
+
+import re
+
+import pytest
+
+# Emulator defaults: 170 us per block transfer, 250 us program busy, 20 us per command.
+# Floors leave ~30 % headroom, so a slower command or data path fails the run.
+READ_KBS_MIN = 2000   # 16 blocks per CMD18
+WRITE_KBS_MIN = 800   # 16 blocks per CMD25
+WRITE_BUSY_US = 250
+
+
+def field(out: str, label: str) -> str:
+    m = re.search(r'^\s*' + re.escape(label) + r'\s*: (.*)$', out, re.MULTILINE)
+    assert m, f"'{label}' not in output"
+    return m.group(1)
+
+
+def kbs(out: str, label: str) -> int:
+    m = re.search(r'(\d+) KB/s', field(out, label))
+    assert m
+    return int(m.group(1))
+
+
+def test_init(sd):
+    out = sd.run('info')
+    assert 'Storage init OK' in out
+    for reg in ('SD_SEND_CID', 'SD_SEND_CSD', 'SD_APP_SEND_SCR', 'SD_APP_SEND_STATUS'):
+        assert f'{reg}, rc 0' in out
+
+
+def test_write_read(sd):
+    out = sd.run('bench write 0 4096 16')
+    assert kbs(out, 'Write') >= WRITE_KBS_MIN
+
+    out = sd.run('bench read 0 4096 16')
+    assert kbs(out, 'Read') >= READ_KBS_MIN
+
+    out = sd.run('scan verify 0 4096')
+    assert field(out, 'Mismatching blocks') == 'none'
+
+
+def test_single_block(sd):
+    out = sd.run('bench write 8192 256 1')
+    assert 'Write' in out
+    out = sd.run('scan verify 8192 256 -1')
+    assert field(out, 'Mismatching blocks') == 'none'
+
+
+def test_scan_bench(sd):
+    # native_sim has no second core to run the checks on
+    out = sd.run('scan bench 0 4096')
+    assert 'No second core' in out
+
+    out = sd.run('scan hash 0 4096')
+    assert re.search(r'CRC32 [0-9A-F]{8}', field(out, 'Serial'))
+
+
+def test_trace(sd):
+    sd.run('trace clear')
+    sd.run('bench write 0 64 16')
+    sd.run('bench read 0 64 16')
+
+    out = sd.run('trace stats')
+    assert re.search(r'^CMD18\s+4\s+0\s', out, re.MULTILINE)
+
+    # Program time is reported as card busy after the transfer, not folded into it
+    m = re.search(r'^CMD25\s+4\s+0\s+\d+\s+\d+\s+\d+\s+(\d+)\s', out, re.MULTILINE)
+    assert m
+    assert int(m.group(1)) >= 16 * WRITE_BUSY_US
+
+
+def test_erase(sd):
+    out = sd.run('erase --verify', timeout=120)
+    assert 'Erase, rc 0' in out
+    assert 'Card is wiped' in out
+
+    # Old bench data must be gone
+    out = sd.run('scan verify 0 16')
+    assert field(out, 'Mismatching blocks').startswith('16,')
+
+
+@pytest.mark.parametrize('fs', ['exfat', 'fat32'])
+def test_format(sd, fs):
+    out = sd.run(f'format -e {fs}', timeout=120)
+    assert 'Done in' in out
+
+    out = sd.run('align')
+    assert field(out, 'File system').startswith('FAT32' if fs == 'fat32' else 'exFAT')
+    assert field(out, 'WAF estimate') == '1.00 cluster writes, 1.00 AU writes'
+    assert field(out, 'Clusters across ES') == '0.0 %'
+
+
+def test_mount(sd):
+    # Last format above was FAT32: the file system driver must accept the volume
+    out = sd.run('fs mount fat /SD:')
+    assert 'Error' not in out
+
+    sd.run('fs write /SD:/test.txt 73 64 74 6f 6f 6c')
+    out = sd.run('fs read /SD:/test.txt')
+    assert '73 64 74 6f 6f 6c' in out.lower()
@@ -0,0 +1,502 @@
+
+// sdinv - fleet inventory batch decoder.
+//
+// Streams logs of raw register dumps ('info -r' output, one 'cid|csd|scr|ssr|cmd6 <hex>'
+// per line, any prefix allowed), decodes them with the firmware decoders (src/sdregs.cpp)
+// on all cores and prints aggregated statistics. A card record starts at each CID line.
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <strings.h>
+
+#include "types.h"
+#include "sdregs.h"
+
+// ----- Input parsing
+
+enum reg_kind { REG_NONE, REG_CID, REG_CSD, REG_SCR, REG_SSR, REG_CMD6 };
+
+static const struct { const char *name; reg_kind kind; int len; } reg_names[] =
+{
+  { "cid",  REG_CID,  16 },
+  { "csd",  REG_CSD,  16 },
+  { "scr",  REG_SCR,   8 },
+  { "ssr",  REG_SSR,  64 },
+  { "cmd6", REG_CMD6, 64 },
+};
+
+static int hex_val(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Drops VT100 control sequences (ESC [ ... final byte), as in serial captures of a
+// shell with colors enabled
+static std::string strip_vt100(const std::string &line)
+{
+  std::string out;
+  out.reserve(line.size());
+
+  for (size_t i = 0; i < line.size(); i++)
+  {
+    if (line[i] == '\x1B' && i + 1 < line.size() && line[i + 1] == '[')
+    {
+      i += 2;
+      while (i < line.size() && !(line[i] >= 0x40 && line[i] <= 0x7E)) i++;
+      continue;
+    }
+
+    out += line[i];
+  }
+
+  return out;
+}
+
+// Finds "<reg> <hex>" in a line. Returns the register kind, or REG_NONE.
+// 'bad' is set when the hex that follows is not exactly one register long.
+static reg_kind parse_line(const std::string &raw_line, u8 *buf, bool &bad)
+{
+  const std::string line = (raw_line.find('\x1B') != std::string::npos) ? strip_vt100(raw_line) : raw_line;
+  const char *s = line.c_str();
+  bad = false;
+
+  for (const char *p = s; *p; p++)
+  {
+    if (p != s && (isalnum((u8)p[-1]) || p[-1] == '_')) continue;
+
+    for (const auto &r : reg_names)
+    {
+      size_t nl = strlen(r.name);
+      if (strncasecmp(p, r.name, nl) || isalnum((u8)p[nl])) continue;
+
+      const char *h = p + nl;
+      while (*h == ' ' || *h == ':' || *h == '=' || *h == '\t') h++;
+
+      int n = 0;
+      while (hex_val(h[n]) >= 0) n++;
+
+      if (n == 0 || isalnum((u8)h[n]) || h[n] == '_') break;  // just a word, e.g. "CID decode:"
+      if (n == 2 * r.len)
+      {
+        for (int i = 0; i < r.len; i++)
+          buf[i] = (u8)((hex_val(h[2 * i]) << 4) | hex_val(h[2 * i + 1]));
+        return r.kind;
+      }
+
+      bad = true;
+      return r.kind;
+    }
+  }
+
+  return REG_NONE;
+}
+
+// ----- Statistics
+
+struct inv_stats
+{
+  u64 cards = 0;
+  u64 errors = 0;
+  u64 no_csd = 0;
+
+  std::map<u32, u64> mid;
+  std::unordered_map<std::string, u64> oid;
+  std::unordered_map<std::string, u64> pnm;
+  std::map<std::string, u64> cap_class;
+  std::map<u64, u64> cap_nominal;  // MB, power of two
+  std::map<u32, u64> year;
+  std::map<u32, u64> au;           // bytes, from SSR when present
+
+  u32 mdt_min = 0xFFFF;
+  u32 mdt_max = 0;
+
+  void merge(const inv_stats &o)
+  {
+    cards  += o.cards;
+    errors += o.errors;
+    no_csd += o.no_csd;
+
+    for (const auto &e : o.mid)         mid[e.first]         += e.second;
+    for (const auto &e : o.oid)         oid[e.first]         += e.second;
+    for (const auto &e : o.pnm)         pnm[e.first]         += e.second;
+    for (const auto &e : o.cap_class)   cap_class[e.first]   += e.second;
+    for (const auto &e : o.cap_nominal) cap_nominal[e.first] += e.second;
+    for (const auto &e : o.year)        year[e.first]        += e.second;
+    for (const auto &e : o.au)          au[e.first]          += e.second;
+
+    mdt_min = std::min(mdt_min, o.mdt_min);
+    mdt_max = std::max(mdt_max, o.mdt_max);
+  }
+};
+
+struct card_rec
+{
+  bool has_cid = false;
+  bool has_csd = false;
+  bool has_ssr = false;
+  u8 cid[16];
+  u8 csd[16];
+  u8 ssr[64];
+};
+
+static std::string printable(const u8 *p, int n)
+{
+  std::string s;
+  for (int i = 0; i < n; i++)
+    s += (p[i] >= 0x20 && p[i] < 0x7F) ? (char)p[i] : '.';
+  return s;
+}
+
+static void account(inv_stats &st, const card_rec &c)
+{
+  if (!c.has_cid) return;
+
+  u32 raw[16];
+  sd_cid cid;
+
+  make_raw_cxd(c.cid, raw);
+  sdmmc_decode_cid(&cid, raw);
+
+  st.cards++;
+  st.mid[cid.manufacturer]++;
+
+  u8 oid[2] = { (u8)(cid.application >> 8), (u8)cid.application };
+  st.oid[printable(oid, 2)]++;
+  st.pnm[printable(cid.name, SD_PRODUCT_NAME_BYTES)]++;
+
+  // MDT: year offset from 2000 in bits 11:4, month in bits 3:0, compares chronologically
+  u32 mdt = cid.date;
+  st.year[2000 + (cid.date >> 4)]++;
+  st.mdt_min = std::min(st.mdt_min, mdt);
+  st.mdt_max = std::max(st.mdt_max, mdt);
+
+  if (c.has_csd)
+  {
+    sd_csd csd;
+    u32 blk_count = 0;
+    u16 blk_size = 0;
+
+    make_raw_cxd(c.csd, raw);
+    sdmmc_decode_csd(&csd, raw, &blk_count, &blk_size);
+
+    u64 bytes = (u64)blk_count * blk_size;
+    const char *cls = csd.csd_structure == 0 ? "SDSC" :
+                      csd.csd_structure == 2 ? "SDUC" :
+                      csd.csd_structure == 1 ? (bytes <= (32ull << 30) ? "SDHC" : "SDXC") :
+                                               "reserved";
+    st.cap_class[cls]++;
+
+    // Nominal size: decimal capacity rounded up to a power of two
+    u64 mb = bytes / 1000000;
+    u64 nominal = 1;
+    while (nominal < mb) nominal <<= 1;
+    st.cap_nominal[nominal]++;
+  }
+  else
+    st.no_csd++;
+
+  if (c.has_ssr)
+  {
+    make_raw_words(c.ssr, raw, 16);
+    st.au[ssr_au_bytes(reg_get(raw, ssr::AU_SIZE))]++;
+  }
+}
+
+static void decode_batch(const std::vector<std::string> &lines, inv_stats &st)
+{
+  card_rec c;
+  u8 buf[64];
+  bool bad;
+
+  for (const auto &line : lines)
+  {
+    reg_kind k = parse_line(line, buf, bad);
+    if (k == REG_NONE) continue;
+
+    if (bad)
+    {
+      st.errors++;
+
+      // A broken CID still ends the previous card: its CSD/SSR must not be merged into it
+      if (k == REG_CID)
+      {
+        account(st, c);
+        c = card_rec();
+      }
+      continue;
+    }
+
+    switch (k)
+    {
+      case REG_CID:
+        account(st, c);
+        c = card_rec();
+        c.has_cid = true;
+        memcpy(c.cid, buf, 16);
+        break;
+
+      case REG_CSD:
+        c.has_csd = true;
+        memcpy(c.csd, buf, 16);
+        break;
+
+      case REG_SSR:
+        c.has_ssr = true;
+        memcpy(c.ssr, buf, 64);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  account(st, c);
+}
+
+// ----- Work queue: the reader cuts batches at CID lines so records never straddle
+
+struct batch_queue
+{
+  std::mutex m;
+  std::condition_variable cv_get;
+  std::condition_variable cv_put;
+  std::queue<std::vector<std::string>> q;
+  size_t limit;
+  bool done = false;
+
+  explicit batch_queue(size_t lim) : limit(lim) {}
+
+  void put(std::vector<std::string> &&b)
+  {
+    std::unique_lock<std::mutex> lk(m);
+    cv_put.wait(lk, [&] { return q.size() < limit; });
+    q.push(std::move(b));
+    cv_get.notify_one();
+  }
+
+  bool get(std::vector<std::string> &b)
+  {
+    std::unique_lock<std::mutex> lk(m);
+    cv_get.wait(lk, [&] { return !q.empty() || done; });
+    if (q.empty()) return false;
+    b = std::move(q.front());
+    q.pop();
+    cv_put.notify_one();
+    return true;
+  }
+
+  void finish()
+  {
+    std::lock_guard<std::mutex> lk(m);
+    done = true;
+    cv_get.notify_all();
+  }
+};
+
+static void read_stream(std::istream &in, batch_queue &q, size_t batch_lines)
+{
+  std::vector<std::string> batch;
+  std::string line;
+  u8 buf[64];
+  bool bad;
+
+  batch.reserve(batch_lines);
+
+  while (std::getline(in, line))
+  {
+    if (batch.size() >= batch_lines && parse_line(line, buf, bad) == REG_CID)
+    {
+      q.put(std::move(batch));
+      batch = std::vector<std::string>();
+      batch.reserve(batch_lines);
+    }
+
+    batch.push_back(std::move(line));
+  }
+
+  if (!batch.empty())
+    q.put(std::move(batch));
+}
+
+// ----- Report
+
+template <typename K>
+static std::vector<std::pair<K, u64>> by_count(const std::map<K, u64> &m)
+{
+  std::vector<std::pair<K, u64>> v(m.begin(), m.end());
+  std::stable_sort(v.begin(), v.end(), [](const std::pair<K, u64> &a, const std::pair<K, u64> &b) { return a.second > b.second; });
+  return v;
+}
+
+static std::vector<std::pair<std::string, u64>> by_count(const std::unordered_map<std::string, u64> &m)
+{
+  return by_count(std::map<std::string, u64>(m.begin(), m.end()));
+}
+
+static double pct(u64 n, u64 total)
+{
+  return total ? 100.0 * n / total : 0.0;
+}
+
+static void print_report(const inv_stats &st, size_t top)
+{
+  printf("Cards              : %llu\n", (unsigned long long)st.cards);
+  printf("Bad dump lines     : %llu\n", (unsigned long long)st.errors);
+  printf("Cards without CSD  : %llu\n", (unsigned long long)st.no_csd);
+
+  if (st.cards)
+    printf("Date range (MDT)   : %04u-%02u .. %04u-%02u\n",
+           2000 + (st.mdt_min >> 4), st.mdt_min & 0xF, 2000 + (st.mdt_max >> 4), st.mdt_max & 0xF);
+
+  printf("\nManufacturers (MID):\n");
+  size_t i = 0;
+  for (const auto &e : by_count(st.mid))
+  {
+    if (i++ == top) break;
+    printf("  0x%02X %-40.40s %10llu %6.2f%%\n", e.first, mid_to_name(e.first),
+           (unsigned long long)e.second, pct(e.second, st.cards));
+  }
+
+  printf("\nOEM IDs (OID):\n");
+  i = 0;
+  for (const auto &e : by_count(st.oid))
+  {
+    if (i++ == top) break;
+    printf("  %-45s %10llu %6.2f%%\n", e.first.c_str(), (unsigned long long)e.second, pct(e.second, st.cards));
+  }
+
+  printf("\nProducts (PNM):\n");
+  i = 0;
+  for (const auto &e : by_count(st.pnm))
+  {
+    if (i++ == top) break;
+    printf("  %-45s %10llu %6.2f%%\n", e.first.c_str(), (unsigned long long)e.second, pct(e.second, st.cards));
+  }
+
+  u64 with_csd = st.cards - st.no_csd;
+
+  printf("\nCapacity classes:\n");
+  for (const auto &e : st.cap_class)
+    printf("  %-45s %10llu %6.2f%%\n", e.first.c_str(), (unsigned long long)e.second, pct(e.second, with_csd));
+
+  printf("\nNominal capacity:\n");
+  for (const auto &e : st.cap_nominal)
+  {
+    char s[32];
+    if (e.first >= 1024)
+      snprintf(s, sizeof(s), "%llu GB", (unsigned long long)(e.first >> 10));
+    else
+      snprintf(s, sizeof(s), "%llu MB", (unsigned long long)e.first);
+    printf("  %-45s %10llu %6.2f%%\n", s, (unsigned long long)e.second, pct(e.second, with_csd));
+  }
+
+  printf("\nManufacturing year:\n");
+  for (const auto &e : st.year)
+    printf("  %-45u %10llu %6.2f%%\n", e.first, (unsigned long long)e.second, pct(e.second, st.cards));
+
+  if (!st.au.empty())
+  {
+    u64 with_ssr = 0;
+    for (const auto &e : st.au) with_ssr += e.second;
+
+    printf("\nAU size (SSR):\n");
+    for (const auto &e : st.au)
+    {
+      char s[32];
+      if (e.first >= (1u << 20))
+        snprintf(s, sizeof(s), "%u MB", e.first >> 20);
+      else
+        snprintf(s, sizeof(s), "%u KB", e.first >> 10);
+      printf("  %-45s %10llu %6.2f%%\n", e.first ? s : "not defined", (unsigned long long)e.second, pct(e.second, with_ssr));
+    }
+  }
+}
+
+// ----- Main
+
+static void usage()
+{
+  fprintf(stderr,
+    "Usage: sdinv [-j threads] [-n top] [-b batch_lines] [file...]\n"
+    "Reads stdin when no files are given.\n");
+}
+
+int main(int argc, char **argv)
+{
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t top = 20;
+  size_t batch_lines = 16384;
+  std::vector<const char *> files;
+
+  for (int a = 1; a < argc; a++)
+  {
+    if (!strcmp(argv[a], "-j") && a + 1 < argc)      threads = std::max(1, atoi(argv[++a]));
+    else if (!strcmp(argv[a], "-n") && a + 1 < argc) top = strtoul(argv[++a], NULL, 0);
+    else if (!strcmp(argv[a], "-b") && a + 1 < argc) batch_lines = std::max(1ul, strtoul(argv[++a], NULL, 0));
+    else if (argv[a][0] == '-' && argv[a][1])
+    {
+      usage();
+      return 2;
+    }
+    else
+      files.push_back(argv[a]);
+  }
+
+  batch_queue q(threads * 2);
+  std::vector<inv_stats> stats(threads);
+  std::vector<std::thread> workers;
+
+  for (unsigned t = 0; t < threads; t++)
+  {
+    workers.emplace_back([&q, &stats, t]
+    {
+      std::vector<std::string> b;
+      while (q.get(b))
+        decode_batch(b, stats[t]);
+    });
+  }
+
+  int rc = 0;
+
+  if (files.empty())
+    read_stream(std::cin, q, batch_lines);
+
+  for (const char *f : files)
+  {
+    std::ifstream in(strcmp(f, "-") ? f : "/dev/stdin");
+    if (!in)
+    {
+      fprintf(stderr, "sdinv: cannot open '%s'\n", f);
+      rc = 1;
+      continue;
+    }
+    read_stream(in, q, batch_lines);
+  }
+
+  q.finish();
+  for (auto &w : workers)
+    w.join();
+
+  inv_stats total;
+  for (const auto &s : stats)
+    total.merge(s);
+
+  print_report(total, top);
+  return rc;
+}